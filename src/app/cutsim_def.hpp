@@ -18,15 +18,39 @@
 #define COLLISION_TOLERANCE	(2e-2)
 
 #define POOL_NODE
+// size in bytes of the slabs from which the node pool allocates child blocks
+#define NODE_POOL_SLAB_SIZE		(256*1024)
+// store the corner distances of the octree nodes as 16-bit integers relative to the node scale
+#define COMPACT_NODE
+// distances are clamped to +-COMPACT_NODE_RANGE times the node scale
+#define COMPACT_NODE_RANGE		(8.0)
 
 //#define WIRE_FRAME
+// marching cubes shares the vertex on an octree edge between the triangles and leaves which meet there
+#define MC_SHARED_VERTEX
+// marching cubes polygonizes the changed leaves with parallel threads when there are at least this many, 0 for serial
+#define DEFAULT_MC_PARALLEL_LEAVES	(512)
+// GLData copies the vertices and indices changed by an update to the other buffer in chunks of this many elements
+#define GLDATA_CHUNK_SIZE	(256)
 
 #define DEFAULT_SCENE_RADIUS	(100)
 
 #define DEFAULT_CUBE_SIZE		(100.0)
 #define DEFAULT_MAX_DEPTH		(9)
+// the children of octree nodes above this depth are traversed by parallel tasks, 0 for serial
+#define DEFAULT_PARALLEL_DEPTH	(3)
+// depth of the integer lattice holding all octree node corners, must exceed the tree depth
+#define OCTREE_LATTICE_DEPTH	(24)
+
+// sample the distance of STL stock and parts at the octree leaf resolution and cache it next to the STL file
+#define STL_SDF_CACHE
+// half-width of the sampled band around the STL surface, in octree leaf side-lengths.
+// At least COMPACT_NODE_RANGE/2, the distance beyond which leaves clamp their corner values.
+#define STL_SDF_BAND			(4.0)
 
 #define DEFAULT_STEP_SIZE		(0.1)
+// diff each straight move at a fixed angle at once, with the volume swept by the cutter
+#define SWEPT_MOVE
 
 #define TOOL_BODY_COLOR		0.9, 0.9, 0.85
 #define TOOL_FLUTE_COLOR	0.7, 0.7, 0.65
@@ -72,6 +72,13 @@ CutsimWindow::CutsimWindow(QStringList ags) : args(ags), myLastFolder(tr("")), s
         connect( myPlayer, SIGNAL( signalToolPosition(double,double,double,double,double,double,int,int,double) ), this, SLOT( slotSetToolPosition(double,double,double,double,double,double,int,int,double) ) );
 #else
         connect( myPlayer, SIGNAL( signalToolPosition(double,double,double,int,int,double) ), this, SLOT( slotSetToolPosition(double,double,double,int,int,double) ) );
+#endif
+#ifdef SWEPT_MOVE
+#ifdef MULTI_AXIS
+        connect( myPlayer, SIGNAL( signalToolMove(double,double,double,double,double,double,double,double,double,double,double,double,int,int,double) ), this, SLOT( slotSetToolMove(double,double,double,double,double,double,double,double,double,double,double,double,int,int,double) ) );
+#else
+        connect( myPlayer, SIGNAL( signalToolMove(double,double,double,double,double,double,double,double,double,int,int,double) ), this, SLOT( slotSetToolMove(double,double,double,double,double,double,double,double,double,int,int,double) ) );
+#endif
 #endif
         connect( myPlayer, SIGNAL( signalToolChange( int ) ), this, SLOT( slotToolChange(int) ) );     
         
@@ -97,7 +104,9 @@ CutsimWindow::CutsimWindow(QStringList ags) : args(ags), myLastFolder(tr("")), s
         myTools.push_back(s0);
 
         currentTool = 0;
+        myToolDiff = cutsim::Octree::cutterDiff(myTools[currentTool]);
 		myGLWidget->setTool(myTools[currentTool]);
+        mySweep = new cutsim::SweptCutterVolume();
 
         chooseToolTable();
         chooseSetupFile();
@@ -110,16 +119,6 @@ CutsimWindow::CutsimWindow(QStringList ags) : args(ags), myLastFolder(tr("")), s
         connect( myCutsim, SIGNAL( signalDiffDone(int,int,int,double) ), this, SLOT( slotDiffDone(int,int,int,double) ) );
         connect( myCutsim, SIGNAL( signalGLDone() ), this, SLOT( slotGLDone() ) );
 
-        // hard-coded stock
-        cutsim::RectVolume2* stock0 = new cutsim::RectVolume2();
-        stock0->setWidth(1.0);
-        stock0->setLength(1.0);
-        stock0->setHight(1.0);
-        stock0->setCenter(cutsim::GLVertex(0.0, 0.0, 0.0));
-        stock0->calcBB();
-        stock0->setColor(STOCK_COLOR);
-        myCutsim->sum_volume(stock0);
-
         QString title = tr(" cutsim - ") + VERSION_STRING;
         setWindowTitle(title);
         showNormal();
@@ -135,29 +134,29 @@ CutsimWindow::CutsimWindow(QStringList ags) : args(ags), myLastFolder(tr("")), s
 CutsimWindow::~CutsimWindow()
 {
 	delete myMachine;
+	delete mySweep;
 	delete myPlayer;
 	delete myG2m;
 	delete myProgress;
 	delete myCutsim;
 	delete myGLWidget;
+	delete octree_center;
 }
 
 // >> means signal.
 //slotRequestMove >> slotSetToolPosition -> slot_diff_volume_mt >> slotDiffDone -> update_gl_mt >> slotGLDone >> slotRequestMove
 // called by gplayer
 #ifdef MULTI_AXIS
-void CutsimWindow::slotSetToolPosition(double x, double y, double z, double a, double b, double c, int line, int mstatus, double feedrate) {
-{static int preline, preerror;
+void CutsimWindow::checkMachineLimit(double x, double y, double z, double a, double c, int line) {
+static int preline, preerror;
 int error;
-if ((preline != line) && (error = myMachine->checkLimit(x, y, z, a, 0.0, b)) && (preerror != error)) {
+if ((preline != line) && (error = myMachine->checkLimit(x, y, z, a, 0.0, c)) && (preerror != error)) {
 	QString message = tr("Machine limit %1").arg(error) + tr("@ line:%1 ").arg(myG2m->toGcodeLineNo(line))
 			        + tr(" X:%1").arg(x)
 					+ tr(" Y:%1").arg(y)
 					+ tr(" Z:%1").arg(z)
-#ifdef MULTI_AXIS
 					+ tr(" A:%1").arg(SIGN_A*(a))
-					+ tr(" C:%1").arg(SIGN_C*(b))
-#endif
+					+ tr(" C:%1").arg(SIGN_C*(c))
 					;
 	debugMessage(message);
 	pauseProgram();
@@ -165,6 +164,11 @@ if ((preline != line) && (error = myMachine->checkLimit(x, y, z, a, 0.0, b)) &&
 	preerror = error;
 }
 }
+#endif
+
+#ifdef MULTI_AXIS
+void CutsimWindow::slotSetToolPosition(double x, double y, double z, double a, double b, double c, int line, int mstatus, double feedrate) {
+    checkMachineLimit(x, y, z, a, b, line);
     myTools[currentTool]->setAngle( cutsim::GLVertex(a,0.0,b) );
     myGLWidget->setToolPosition(x,y,z,a,0.0,b);
 #else
@@ -172,7 +176,39 @@ void CutsimWindow::slotSetToolPosition(double x, double y, double z, int line, i
     myGLWidget->setToolPosition(x,y,z);
 #endif
     myTools[currentTool]->setCenter( cutsim::GLVertex(x,y,z) );
-    myCutsim->slot_diff_volume_mt( myTools[currentTool], line, mstatus, feedrate);
+    myCutsim->slot_diff_volume_mt( myTools[currentTool], line, mstatus, feedrate, myToolDiff );
+}
+
+// called by gplayer for a straight move or an arc. The tool is left at the end of the move.
+#ifdef MULTI_AXIS
+void CutsimWindow::slotSetToolMove(double x0, double y0, double z0, double x1, double y1, double z1, double cx, double cy, double sweep, double a, double b, double c, int line, int mstatus, double feedrate) {
+    myTools[currentTool]->setAngle( cutsim::GLVertex(a,0.0,b) );
+    myGLWidget->setToolPosition(x1,y1,z1,a,0.0,b);
+#else
+void CutsimWindow::slotSetToolMove(double x0, double y0, double z0, double x1, double y1, double z1, double cx, double cy, double sweep, int line, int mstatus, double feedrate) {
+    myGLWidget->setToolPosition(x1,y1,z1);
+#endif
+    mySweep->setTool( myTools[currentTool] );
+    if (sweep != 0.0)
+    	mySweep->setArc( cutsim::GLVertex(x0,y0,z0), cutsim::GLVertex(x1,y1,z1), cutsim::GLVertex(cx,cy,0.0), sweep );
+    else
+    	mySweep->setMove( cutsim::GLVertex(x0,y0,z0), cutsim::GLVertex(x1,y1,z1) );
+#ifdef MULTI_AXIS
+    // a straight move stays within the limits of its end points, an arc may bulge out between them
+    checkMachineLimit(x0, y0, z0, a, b, line);
+    std::vector<cutsim::GLVertex> extremes;
+    mySweep->getArcExtremes(extremes);
+    cutsim::GLVertex tip = mySweep->getCenter() - cutsim::GLVertex(x1,y1,z1); // the cutter center above the position
+    for (unsigned int k=0;k<extremes.size();++k)
+        checkMachineLimit(extremes[k].x - tip.x, extremes[k].y - tip.y, extremes[k].z - tip.z, a, b, line);
+    checkMachineLimit(x1, y1, z1, a, b, line);
+#endif
+    // the cutting power is reported per sample, as if the move had been sampled. Each sample cuts deeper
+    // into the corners which the front of the cutter passes, about a cutter radius along the move, so a
+    // sample counts about cutcount * radius / pathlength of them. This errs high rather than low.
+    double radius = myTools[currentTool]->radius;
+    double length = mySweep->getPathLength();
+    myCutsim->slot_diff_volume_mt( mySweep, line, mstatus, (length > radius) ? feedrate * radius / length : feedrate );
 }
 
 void CutsimWindow::slotDiffDone(int line, int mstatus, int error, double cuttingPower) { // called when the cut-thread is done and we can update GL
@@ -242,6 +278,8 @@ void CutsimWindow::slotToolChange(int t) {
     } else
     	debugMessage( tr("Can't find tool No.%1").arg(t));
 
+	// the diff for the type of the tool is chosen here, not for every sample
+	myToolDiff = cutsim::Octree::cutterDiff(myTools[currentTool]);
 	myGLWidget->setTool(myTools[currentTool]);
 }    
 
@@ -420,7 +458,6 @@ int CutsimWindow::readToolTable(QString file) {
             switch (tool_Id) {
             case cutsim::CYLINDER: {
             	cutsim::CylCutterVolume* cylCutter = new cutsim::CylCutterVolume();
-            	cylCutter->cuttertype = cutsim::CYLINDER;
             	message += tr("Tool:CYLN ");
             	cylCutter->setLength(d[0]);
             	message += tr("Len. %1 ").arg(d[0]);
@@ -453,7 +490,6 @@ int CutsimWindow::readToolTable(QString file) {
             	}
             case cutsim::BALL: {
             	cutsim::BallCutterVolume* ballCutter = new cutsim::BallCutterVolume();
-            	ballCutter->cuttertype = cutsim::BALL;
             	message += tr("Tool:BALL ");
             	ballCutter->setLength(d[0]);
             	message += tr("Len. %1 ").arg(d[0]);
@@ -812,6 +848,9 @@ int CutsimWindow::readStockFile(QTextStream &in, bool parts, int& lineNo) {
 				int error;
 				error = stock->readStlFile(path);
 				if (error == 0) {
+#ifdef STL_SDF_CACHE
+					stock->useSdfGrid(*octree_center, octree_cube_size * 2.0 / pow(2.0, max_depth - 1));
+#endif
 					if (parts)
 						stock->setColor(PARTS_COLOR);
 					else
@@ -844,25 +883,29 @@ int CutsimWindow::readStockFile(QTextStream &in, bool parts, int& lineNo) {
 
 /// create stock & parts
 void CutsimWindow::createStockParts() {
+	if (myStocks.empty())
+		return;
+	// the blocks of the stock file, in order, applied to the tree in one pass
+	cutsim::CsgVolume* csg = new cutsim::CsgVolume();
 	for (int i = 0; i < (int)myStocks.size(); i++) {
-//std::cout << "operation type: " << myStocks[i]->operation << " " << i << "\n";
 		switch (myStocks[i]->operation) {
 		case SUM_OPERATION:
-//std::cout << "sum oeration\n";
-			myCutsim->sum_volume(myStocks[i]->stock);
+			csg->add(cutsim::CSG_SUM, myStocks[i]->stock);
 			break;
 		case DIFF_OPERATION:
-			myCutsim->diff_volume(myStocks[i]->stock);
+			csg->add(cutsim::CSG_DIFF, myStocks[i]->stock);
 			break;
 		case INTERSECT_OPERATION:
-			myCutsim->intersect_volume(myStocks[i]->stock);
+			csg->add(cutsim::CSG_INTERSECT, myStocks[i]->stock);
 			break;
-		default: ;
+		default:
+			delete myStocks[i]->stock;
 		}
-		delete myStocks[i]->stock;
 		delete myStocks[i];
 	}
 	myStocks.clear();
+	myCutsim->apply_volume(csg);
+	delete csg;	// deletes the stock volumes
 }
 
 ///find the machine spec file. uses QSettings, to preselect the last file used
@@ -92,6 +92,12 @@ preline = line;
     void slotSetToolPosition(double x, double y, double z, double a, double b, double c, int line, int mstatus, double feedrate);
 #else
     void slotSetToolPosition(double x, double y, double z, int line, int mstatus, double feedrate);
+#endif
+    /// diff a straight move or an arc of the tool at once
+#ifdef MULTI_AXIS
+    void slotSetToolMove(double x0, double y0, double z0, double x1, double y1, double z1, double cx, double cy, double sweep, double a, double b, double c, int line, int mstatus, double feedrate);
+#else
+    void slotSetToolMove(double x0, double y0, double z0, double x1, double y1, double z1, double cx, double cy, double sweep, int line, int mstatus, double feedrate);
 #endif
     /// change the tool
     void slotToolChange(int t);
@@ -164,6 +170,10 @@ private:
     void createStockParts();
     // read machine spec. file and set
     int readMachineSpecFile(QString file);
+#ifdef MULTI_AXIS
+    // report when the tool leaves the machine limits
+    void checkMachineLimit(double x, double y, double z, double a, double c, int line);
+#endif
 
     QMenu* fileMenu;
     QMenu* helpMenu;
@@ -183,8 +193,12 @@ private:
     cutsim::GLWidget* myGLWidget;
     
     std::vector<cutsim::CutterVolume*> myTools;
+    /// the volume swept by the current tool along a move
+    cutsim::SweptCutterVolume* mySweep;
 
     unsigned int currentTool;
+    /// the diff_c() variant for the type of the current tool, see cutsim::Octree::cutterDiff()
+    cutsim::Octree::CutterDiff myToolDiff;
     g2m::g2m* myG2m;
     g2m::GPlayer* myPlayer;
     TextArea* debugText;
@@ -32,12 +32,22 @@ Bbox::Bbox() {
     minpt = GLVertex(0,0,0);
     maxpt = GLVertex(0,0,0);
     initialized = false;
+    armvec = (maxpt - minpt) * 0.5;
+    centerpt = minpt + armvec;
+#ifdef MULTI_AXIS
+    setAngle( GLVertex(0,0,0) );
+#endif
 }
 //              minx       maxx        miny       maxy       minz       maxz
 Bbox::Bbox(double b1, double b2, double b3, double b4, double b5, double b6) {
     minpt = GLVertex(b1,b3,b5);
     maxpt = GLVertex(b2,b4,b6);
     initialized = true;
+    armvec = (maxpt - minpt) * 0.5;
+    centerpt = minpt + armvec;
+#ifdef MULTI_AXIS
+    setAngle( GLVertex(0,0,0) );
+#endif
 }
 
 void Bbox::clear() {
@@ -87,13 +97,29 @@ void Bbox::addPoint(const GLVertex &p) {
     armvec = (maxpt - minpt) * 0.5;
     centerpt = minpt + armvec;
 //#endif
+#ifdef MULTI_AXIS
+    calcOriented();
+#endif
+}
+
+#ifdef MULTI_AXIS
+void Bbox::calcOriented() {
+    // rotation is orthonormal, its transpose turns back
+    const GLfloat (&M)[3][3] = rotation;
+    orientedcenterpt = GLVertex( M[0][0] * centerpt.x + M[1][0] * centerpt.y + M[2][0] * centerpt.z,
+                                 M[0][1] * centerpt.x + M[1][1] * centerpt.y + M[2][1] * centerpt.z,
+                                 M[0][2] * centerpt.x + M[1][2] * centerpt.y + M[2][2] * centerpt.z );
+    for (int i = 0; i < 3; ++i)
+        for (int j = 0; j < 3; ++j)
+            absrotation[i][j] = fabs(M[i][j]) + 1e-6; // against rounding on nearly parallel axes
 }
+#endif
 
 /// does this Bbox overlap with b?
 bool Bbox::overlaps(const Bbox& b) const {
 #ifdef MULTI_AXIS
 	GLVertex centerpt = b.centerpt;
-	centerpt = centerpt.rotateAC(this->angle.x , this->angle.z);
+	centerpt = centerpt.rotateAC(this->rotation);
 	GLVertex maxpt = centerpt + b.armvec;
 	GLVertex minpt = centerpt - b.armvec;;
     if  ( (this->maxpt.x < minpt.x) || (this->minpt.x > maxpt.x) )
@@ -116,6 +142,60 @@ bool Bbox::overlaps(const Bbox& b) const {
 #endif
 }
 
+bool Bbox::overlapsCube(const GLVertex& center, double half) const {
+#ifdef MULTI_AXIS
+	GLVertex c = center;
+	c = c.rotateAC(this->rotation);
+#else
+	const GLVertex& c = center;
+#endif
+    if  ( (this->maxpt.x < c.x - half) || (this->minpt.x > c.x + half) )
+        return false;
+    else if ( (this->maxpt.y < c.y - half) || (this->minpt.y > c.y + half) )
+        return false;
+    else if ( (this->maxpt.z < c.z - half) || (this->minpt.z > c.z + half) )
+        return false;
+    else
+        return true;
+}
+
+// separating-axis test of the box on the axes of the frame of this box (the rows of rotation) against
+// the cube on the axes of the octree: the three axes of each and their nine cross products
+bool Bbox::overlapsCubeOriented(const GLVertex& center, double half) const {
+#ifdef MULTI_AXIS
+    const GLfloat (&R)[3][3] = rotation;
+    const GLfloat (&A)[3][3] = absrotation;
+    const double a[3] = { armvec.x, armvec.y, armvec.z };
+    const double d[3] = { center.x - orientedcenterpt.x, center.y - orientedcenterpt.y, center.z - orientedcenterpt.z };
+    // the axes of the cube
+    for (int j = 0; j < 3; ++j) {
+        if ( fabs(d[j]) > half + a[0] * A[0][j] + a[1] * A[1][j] + a[2] * A[2][j] )
+            return false;
+    }
+    // the axes of this box
+    double t[3];
+    for (int i = 0; i < 3; ++i) {
+        t[i] = R[i][0] * d[0] + R[i][1] * d[1] + R[i][2] * d[2];
+        if ( fabs(t[i]) > a[i] + half * (A[i][0] + A[i][1] + A[i][2]) )
+            return false;
+    }
+    // the cross products of an axis of this box and an axis of the cube
+    for (int i = 0; i < 3; ++i) {
+        int i1 = (i + 1) % 3, i2 = (i + 2) % 3;
+        for (int j = 0; j < 3; ++j) {
+            int j1 = (j + 1) % 3, j2 = (j + 2) % 3;
+            double ra = a[i1] * A[i2][j] + a[i2] * A[i1][j];
+            double rb = half * (A[i][j1] + A[i][j2]);
+            if ( fabs(t[i2] * R[i1][j] - t[i1] * R[i2][j]) > ra + rb )
+                return false;
+        }
+    }
+    return true;
+#else
+    return overlapsCube(center, half);
+#endif
+}
+
 // return the bounding box values as a vector:
 //  0    1    2    3    4    5
 // [minx maxx miny maxy minz maxz]
@@ -41,6 +41,11 @@ class Bbox {
         bool isInside(GLVertex& p) const;
         /// return true if *this overlaps Bbox b
         bool overlaps(const Bbox& other) const;
+        /// return true if *this overlaps the axis-aligned cube with the given center and half side-length
+        bool overlapsCube(const GLVertex& center, double half) const;
+        /// return true if *this, turned by its angle, overlaps the axis-aligned cube with the given center
+        /// and half side-length. Unlike overlapsCube() this is exact for a turned box: a separating-axis test.
+        bool overlapsCubeOriented(const GLVertex& center, double half) const;
 
         /// reset the Bbox (sets initialized=false)
         void clear();
@@ -55,13 +60,26 @@ class Bbox {
         /// the minimum point
         GLVertex minpt;
 #ifdef MULTI_AXIS
+        /// set the angle of the volume and its rotation matrix
+        void setAngle(const GLVertex& a) {
+            angle = a;
+            GLVertex::rotationAC(a.x, a.z, rotation);
+            calcOriented();
+        }
         GLVertex centerpt;		// the mean point of maxpt & minpt
         GLVertex armvec;		// the vector from centerpt to maxpt
         GLVertex angle;			// the angle of volume.
+        GLfloat rotation[3][3];	// rotation matrix of angle, see setAngle()
+        GLfloat absrotation[3][3];	// absolute values of rotation, for overlapsCubeOriented()
+        GLVertex orientedcenterpt;	// centerpt turned back into the frame of the octree
 #endif
     private:
         /// false until one Point or one Triangle has been added
         bool initialized;
+#ifdef MULTI_AXIS
+        /// update absrotation and orientedcenterpt
+        void calcOriented();
+#endif
 };
 
 } // end namespace
@@ -36,6 +36,7 @@ public:
     /// create algorithm
     CubeWireFrame(GLData* gl, Octree* tr ) : IsoSurfaceAlgorithm(gl,tr) {
         g->setLines(); // two indexes per line-segment
+        g->setBlockPolygons(12); // the edges of a cube
         inside_color.set(0,0,1);
         undecided_color.set(0,1,0);
         outside_color.set(0.3,0,0);
@@ -63,7 +64,7 @@ protected:
             return;
         } else if ( !node->valid() ) {
             update_calls++;
-            node->clearVertexSet(); // remove all previous GLData
+            node->clearBlock(); // remove all previous GLData
             
             // add lines corresponding to the cube.
             const int segTable[12][2] = { // cube image: http://paulbourke.net/geometry/polygonise/
@@ -76,10 +77,11 @@ if (node->isLeaf()) {
                  (node->is_outside() && draw_outside) ||
                  (node->is_undecided() && draw_undecided) 
                 ) {
+                unsigned int block = node->block();
                 for (unsigned int i=0; i <12 ; i++ ) {
-                    std::vector< unsigned int > lineSeg;
-                    GLVertex p1 = *(node->vertex)[ segTable[i][0 ] ];
-                    GLVertex p2 = *(node->vertex)[ segTable[i][1 ] ];
+                    GLuint lineSeg[2];
+                    GLVertex p1 = node->getVertex( segTable[i][0 ] );
+                    GLVertex p2 = node->getVertex( segTable[i][1 ] );
                     Color line_color;
                     if (node->is_outside()) {
                         line_color = outside_color;
@@ -93,11 +95,11 @@ if (node->isLeaf()) {
                     p1.setColor( line_color );
                     p2.setColor( line_color );
                         
-                    lineSeg.push_back( g->addVertex( p1, node ) );
-                    lineSeg.push_back( g->addVertex( p2, node ) );
-                    node->addIndex( lineSeg[0] ); 
-                    node->addIndex( lineSeg[1] ); 
-                    g->addPolygon( lineSeg );
+                    lineSeg[0] = g->addVertex( p1 );
+                    lineSeg[1] = g->addVertex( p2 );
+                    g->addBlockVertex( block, lineSeg[0] );
+                    g->addBlockVertex( block, lineSeg[1] );
+                    g->addBlockPolygon( block, lineSeg );
                 }
             }
             node->setValid();
@@ -106,8 +108,8 @@ if (node->isLeaf()) {
             // current node done, now recurse into tree.
             if ( node->childcount == 8 ) {
                 for (unsigned int m=0;m<8;m++) {
-                    //if ( !node->child[m]->valid() )
-                        updateGL( node->child[m] );
+                    //if ( !node->child[m].valid() )
+                        updateGL( &node->child[m] );
                 }
             }
         }
@@ -75,4 +75,12 @@ void Cutsim::intersect_volume( const Volume* volume ) {
     std::cout << "cutsim.cpp intersect_volume()  :" << ( ( stop - start ) / (double)CLOCKS_PER_SEC ) <<'\n';
 }
 
+void Cutsim::apply_volume( const CsgVolume* csg ) {
+    std::clock_t start, stop;
+    start = std::clock();
+    tree->apply( csg );
+    stop = std::clock();
+    std::cout << "cutsim.cpp apply_volume()  :" << ( ( stop - start ) / (double)CLOCKS_PER_SEC ) <<'\n';
+}
+
 } // end namespace
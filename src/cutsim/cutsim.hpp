@@ -51,8 +51,8 @@ class DiffTask : public QObject, public QRunnable  {
     Q_OBJECT
 
 public:
-    /// create task for cutting Volume from Octree which is drawn with GLData
-    DiffTask(Octree* t, GLData* g, const Volume* v, int l, int ms, double fr ) : tree(t), gld(g), vol(v), line(l), mstatus(ms), feedrate(fr) { }
+    /// create task for cutting Volume from Octree which is drawn with GLData, with the diff_c() variant d
+    DiffTask(Octree* t, GLData* g, const Volume* v, Octree::CutterDiff d, int l, int ms, double fr ) : tree(t), gld(g), vol(v), diff(d), line(l), mstatus(ms), feedrate(fr) { }
     /// run the task
     void run() {
     	CuttingStatus cstatus;
@@ -60,7 +60,7 @@ public:
         std::clock_t start, stop;
         start = std::clock();
 //        tree->diff( vol );
-        cstatus = tree->diff_c( vol );
+        cstatus = (tree->*diff)( vol );
         stop = std::clock();
         qDebug() << "   " << ( ( stop - start ) / (double)CLOCKS_PER_SEC ) ;
         qDebug() << "DiffTask thread DONE " << QThread::currentThread();
@@ -82,6 +82,7 @@ private:
     Octree* tree;
     GLData* gld;
     const Volume* vol;
+    Octree::CutterDiff diff;
     int line;
     int mstatus;
     double feedrate;
@@ -139,6 +140,8 @@ public:
     void sum_volume( const Volume* vol );
     /// intersect/"and" given Volume
     void intersect_volume( const Volume* vol );
+    /// sum, diff or intersect each term of the given CsgVolume, in one pass
+    void apply_volume( const CsgVolume* csg );
     /// update the GL-data
     void updateGL();
 
@@ -160,9 +163,9 @@ public slots:
     }
     /// diff the given Volume from the stock
     void slot_diff_volume( const Volume* vol) { diff_volume(vol);}
-    /// multithreaded diff (FIXME: broken)
-    void slot_diff_volume_mt( const Volume* vol, int line, int mstatus, double feedrate ) {
-        DiffTask* dt = new DiffTask(tree, g, vol, line, mstatus, feedrate);
+    /// multithreaded diff (FIXME: broken). diff is the Octree::cutterDiff() of the cutter, if known.
+    void slot_diff_volume_mt( const Volume* vol, int line, int mstatus, double feedrate, Octree::CutterDiff diff = &Octree::diff_c ) {
+        DiffTask* dt = new DiffTask(tree, g, vol, diff, line, mstatus, feedrate);
         connect( dt, SIGNAL( signalDone(int,int,int,double) ), this, SLOT( slotDiffDone(int,int,int,double) ) );
         QThreadPool::globalInstance()->start(dt);
         
@@ -0,0 +1,136 @@
+/*
+ *  Copyright 2015      Kazuyasu Hamada (k-hamada@gifu-u.ac.jp)
+ *
+ *  This file is part of OpenCAMlib.
+ *
+ *  OpenCAMlib is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  OpenCAMlib is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with OpenCAMlib.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef CUTTER_KERNEL_H
+#define CUTTER_KERNEL_H
+
+#include "volume.hpp"
+#include "float8.hpp"
+
+// the eight-corner kernels of the cutters, inline so that the traversal of Octree::diff_cutter()
+// can call them without virtual dispatch. See cutterDist_cd8().
+
+namespace cutsim {
+
+// the corners p, rotated by M as GLVertex::rotateAC(M) does, moved by shift, less o
+inline void rotateCorners(const Corners& p, const GLfloat M[3][3], const GLVertex& shift, const GLVertex& o,
+                          Float8& x, Float8& y, Float8& z) {
+    Float8 px = Float8::load(p.x);
+    Float8 py = Float8::load(p.y);
+    Float8 pz = Float8::load(p.z);
+    x = px * Float8(M[0][0]) + py * Float8(M[0][1]) + Float8(shift.x) - Float8(o.x);
+    y = px * Float8(M[1][0]) + py * Float8(M[1][1]) + pz * Float8(M[1][2]) + Float8(shift.y) - Float8(o.y);
+    z = px * Float8(M[2][0]) + py * Float8(M[2][1]) + pz * Float8(M[2][2]) + Float8(shift.z) - Float8(o.z);
+}
+
+// the corners p in the coordinate frame of a cutter with the given center and rotation matrix
+inline void cutterCorners(const Corners& p, const GLVertex& center, const GLfloat rotation[3][3],
+                          Float8& x, Float8& y, Float8& z) {
+#ifdef MULTI_AXIS
+    rotateCorners(p, rotation, GLVertex(0.0, 0.0, 0.0), center, x, y, z);
+#else
+    x = Float8::load(p.x) - Float8(center.x);
+    y = Float8::load(p.y) - Float8(center.y);
+    z = Float8::load(p.z) - Float8(center.z);
+#endif
+}
+
+// store the distances f and the collisions of the active corners to r
+inline void storeCutting(const Float8& f, unsigned int neck, unsigned int shank, unsigned int holder,
+                         unsigned int active, Cutting r[8]) {
+    float lanes[8];
+    f.store(lanes);
+    for (int n = 0; n < 8; ++n) {
+        if ( !(active & (1 << n)) )
+            continue;
+        r[n].f = lanes[n];
+        r[n].collision = ((neck   >> n) & 1 ? NECK_COLLISION   : NO_COLLISION)
+                       | ((shank  >> n) & 1 ? SHANK_COLLISION  : NO_COLLISION)
+                       | ((holder >> n) & 1 ? HOLDER_COLLISION : NO_COLLISION);
+    }
+}
+
+// profile_cd() at the eight corners, with the cases of profile_cd() selected lane by lane
+inline void CylCutterVolume::dist_cd8_kernel(const Corners& p, unsigned int active, Cutting r[8]) const {
+    Float8 x, y, z;
+    cutterCorners(p, center, rotation, x, y, z);
+    Float8 zero(0.0f), tol(COLLISION_TOLERANCE);
+    Float8 d = sqrt(x*x + y*y);
+    Mask8 above = z >= zero;
+    // beside the cutter, the radius of the highest segment below the corner
+    Float8 rdiff = Float8(radius) - d;
+    Mask8 neck = z > Float8(flutelength);
+    rdiff = select(neck, Float8(neckradius) - d, rdiff);
+    neck = neck & (rdiff > tol);
+    Mask8 shank = z > Float8(reachlength);
+    rdiff = select(shank, Float8(shankradius) - d, rdiff);
+    shank = shank & (rdiff > tol);
+    Mask8 holder = z > Float8(length);
+    rdiff = select(holder, Float8(holderradius) - d, rdiff);
+    holder = holder & (rdiff > tol);
+    // under the cutter, the flat bottom or the distance to the outer ring
+    Float8 scale = Float8(radius) / d;
+    Float8 rx = x - x * scale;
+    Float8 ry = y - y * scale;
+    Float8 under = select(d < Float8(radius), z, -sqrt(rx*rx + ry*ry + z*z));
+    storeCutting( select(above, min(rdiff, z), under),
+                  (neck & above).bits(), (shank & above).bits(), (holder & above).bits(), active, r );
+}
+
+// profile_cd() at the eight corners, with the cases of profile_cd() selected lane by lane
+inline void BallCutterVolume::dist_cd8_kernel(const Corners& p, unsigned int active, Cutting r[8]) const {
+    Float8 x, y, z;
+    cutterCorners(p, center, rotation, x, y, z);
+    Float8 zero(0.0f), tol(COLLISION_TOLERANCE);
+    Float8 d2 = x*x + y*y;
+    Float8 d = sqrt(d2);
+    Mask8 above = z >= zero;
+    // above the ball, the radius of the highest segment below the corner
+    Float8 f = Float8(radius) - d;
+    Mask8 neck = z > Float8(flutelength);
+    f = select(neck, Float8(neckradius) - d, f);
+    neck = neck & (f > tol);
+    Mask8 shank = z > Float8(reachlength);
+    f = select(shank, Float8(shankradius) - d, f);
+    shank = shank & (f > tol);
+    Mask8 holder = z > Float8(length);
+    f = select(holder, Float8(holderradius) - d, f);
+    holder = holder & (f > tol);
+    storeCutting( select(above, f, Float8(radius) - sqrt(d2 + z*z)),
+                  (neck & above).bits(), (shank & above).bits(), (holder & above).bits(), active, r );
+}
+
+/// dist_cd8() of cutter, dispatched virtually. The overloads for the concrete cutter types inline their kernel.
+inline void cutterDist_cd8(const CutterVolume* cutter, const Corners& p, unsigned int active, Cutting r[8]) {
+    cutter->dist_cd8(p, active, r);
+}
+
+/// the inlined kernel of a CylCutterVolume
+inline void cutterDist_cd8(const CylCutterVolume* cutter, const Corners& p, unsigned int active, Cutting r[8]) {
+    cutter->dist_cd8_kernel(p, active, r);
+}
+
+/// the inlined kernel of a BallCutterVolume
+inline void cutterDist_cd8(const BallCutterVolume* cutter, const Corners& p, unsigned int active, Cutting r[8]) {
+    cutter->dist_cd8_kernel(p, active, r);
+}
+
+} // end namespace
+#endif
+// end file cutter_kernel.hpp
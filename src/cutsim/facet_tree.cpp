@@ -0,0 +1,327 @@
+/*
+ *  Copyright 2015      Kazuyasu Hamada (k-hamada@gifu-u.ac.jp)
+ *
+ *  This file is part of OpenCAMlib.
+ *
+ *  OpenCAMlib is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  OpenCAMlib is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with OpenCAMlib.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <cmath>
+#include <algorithm>
+#include <limits>
+#include <map>
+#include <utility>
+
+#include "facet_tree.hpp"
+
+namespace cutsim {
+
+/// facets per leaf of the tree
+#define FACET_TREE_LEAF_SIZE 4
+
+static inline void sub(const double a[3], const double b[3], double r[3]) {
+    r[0] = a[0] - b[0]; r[1] = a[1] - b[1]; r[2] = a[2] - b[2];
+}
+
+static inline double dot(const double a[3], const double b[3]) {
+    return a[0]*b[0] + a[1]*b[1] + a[2]*b[2];
+}
+
+static inline void cross(const double a[3], const double b[3], double r[3]) {
+    r[0] = a[1]*b[2] - a[2]*b[1];
+    r[1] = a[2]*b[0] - a[0]*b[2];
+    r[2] = a[0]*b[1] - a[1]*b[0];
+}
+
+static inline void addScaled(double r[3], const double a[3], double s) {
+    r[0] += a[0]*s; r[1] += a[1]*s; r[2] += a[2]*s;
+}
+
+/// the angle between a and b
+static inline double angle(const double a[3], const double b[3]) {
+    double c[3];
+    cross(a, b, c);
+    return atan2( sqrt(dot(c, c)), dot(a, b) );
+}
+
+/// orders facets by their centroid along one axis
+struct CentroidLess {
+    CentroidLess(int a) : axis(a) {}
+    template <class T> bool operator()(const T& a, const T& b) const {
+        return a.v[0][axis] + a.v[1][axis] + a.v[2][axis] < b.v[0][axis] + b.v[1][axis] + b.v[2][axis];
+    }
+    int axis;
+};
+
+/// a facet in double precision while the tree is built
+struct FacetTree::Tri {
+    /// the corners
+    double v[3][3];
+    /// the unit normal of the facet
+    double n[3];
+    /// pseudo-normal of edge k, from corner k to corner k+1
+    double en[3][3];
+    /// pseudo-normal of corner k
+    double vn[3][3];
+};
+
+void FacetTable::resize(size_t n) {
+    std::vector<float>* arrays[] = { &ax, &ay, &az, &abx, &aby, &abz, &acx, &acy, &acz, &invAB, &invAC, &invBC, &invN };
+    for (int k = 0; k < (int)(sizeof(arrays) / sizeof(arrays[0])); k++)
+        arrays[k]->resize(n);
+    normals.resize(n);
+}
+
+void FacetTree::build(const std::vector<Facet>& facets) {
+    std::vector<Tri> tris;
+    table.resize(0);
+    nodes.clear();
+
+    // corners are shared by the facets which have exactly the same coordinates
+    typedef std::pair<double, std::pair<double, double> > Key;
+    std::map<Key, int> vertexId;
+    std::vector<int> corner;    // three vertex ids per facet
+    for (int i = 0; i < (int)facets.size(); i++) {
+        const GLVertex* fv[3] = { &facets[i].v1, &facets[i].v2, &facets[i].v3 };
+        Tri t;
+        for (int k = 0; k < 3; k++) {
+            t.v[k][0] = fv[k]->x; t.v[k][1] = fv[k]->y; t.v[k][2] = fv[k]->z;
+        }
+        double e1[3], e2[3];
+        sub(t.v[1], t.v[0], e1);
+        sub(t.v[2], t.v[0], e2);
+        cross(e1, e2, t.n);
+        double len = sqrt(dot(t.n, t.n));
+        if (len == 0.0)
+            continue;   // degenerate facet, it has no area and no normal
+        // the winding gives the normal. Trust the stored normal if the two disagree.
+        const GLVertex& sn = facets[i].normal;
+        double s = ( t.n[0]*sn.x + t.n[1]*sn.y + t.n[2]*sn.z < 0.0 ) ? -1.0 : 1.0;
+        for (int k = 0; k < 3; k++)
+            t.n[k] *= s / len;
+        for (int k = 0; k < 3; k++) {
+            Key key(t.v[k][0], std::make_pair(t.v[k][1], t.v[k][2]));
+            std::map<Key, int>::iterator it = vertexId.find(key);
+            if (it == vertexId.end())
+                it = vertexId.insert( std::make_pair(key, (int)vertexId.size()) ).first;
+            corner.push_back(it->second);
+        }
+        tris.push_back(t);
+    }
+
+    // pseudo-normals: the angle-weighted sum of the facet normals around a vertex
+    // and the sum of the two facet normals along an edge
+    std::vector<double> vertexNormal(3 * vertexId.size(), 0.0);
+    std::map<std::pair<int, int>, int> edgeId;
+    std::vector<double> edgeNormal;
+    std::vector<int> edge(corner.size());
+    for (int i = 0; i < (int)tris.size(); i++) {
+        const Tri& t = tris[i];
+        for (int k = 0; k < 3; k++) {
+            double a[3], b[3];
+            sub(t.v[(k+1)%3], t.v[k], a);
+            sub(t.v[(k+2)%3], t.v[k], b);
+            addScaled(&vertexNormal[3 * corner[3*i+k]], t.n, angle(a, b));
+
+            int v0 = corner[3*i+k], v1 = corner[3*i+(k+1)%3];
+            std::pair<int, int> key( std::min(v0, v1), std::max(v0, v1) );
+            std::map<std::pair<int, int>, int>::iterator it = edgeId.find(key);
+            if (it == edgeId.end()) {
+                it = edgeId.insert( std::make_pair(key, (int)edgeId.size()) ).first;
+                edgeNormal.resize(edgeNormal.size() + 3, 0.0);
+            }
+            edge[3*i+k] = it->second;
+            addScaled(&edgeNormal[3 * it->second], t.n, 1.0);
+        }
+    }
+    for (int i = 0; i < (int)tris.size(); i++) {
+        for (int k = 0; k < 3; k++) {
+            for (int c = 0; c < 3; c++) {
+                tris[i].vn[k][c] = vertexNormal[3 * corner[3*i+k] + c];
+                tris[i].en[k][c] = edgeNormal[3 * edge[3*i+k] + c];
+            }
+        }
+    }
+
+    if (tris.empty())
+        return;
+    nodes.reserve( 2 * tris.size() / FACET_TREE_LEAF_SIZE + 1 );
+    buildNode(tris, 0, (int)tris.size());
+
+    table.resize(tris.size());
+    for (int i = 0; i < (int)tris.size(); i++) {
+        const Tri& t = tris[i];
+        double ab[3], ac[3], bc[3], n[3];
+        sub(t.v[1], t.v[0], ab);
+        sub(t.v[2], t.v[0], ac);
+        sub(t.v[2], t.v[1], bc);
+        cross(ab, ac, n);
+        table.ax[i]  = t.v[0][0]; table.ay[i]  = t.v[0][1]; table.az[i]  = t.v[0][2];
+        table.abx[i] = ab[0];     table.aby[i] = ab[1];     table.abz[i] = ab[2];
+        table.acx[i] = ac[0];     table.acy[i] = ac[1];     table.acz[i] = ac[2];
+        table.invAB[i] = 1.0 / dot(ab, ab);
+        table.invAC[i] = 1.0 / dot(ac, ac);
+        table.invBC[i] = 1.0 / dot(bc, bc);
+        table.invN[i]  = 1.0 / dot(n, n);
+        const double* pseudo[FacetTable::FEATURES] = { t.n, t.en[0], t.en[1], t.en[2], t.vn[0], t.vn[1], t.vn[2] };
+        for (int f = 0; f < FacetTable::FEATURES; f++)
+            for (int c = 0; c < 3; c++)
+                table.normals[i].n[f][c] = pseudo[f][c];
+    }
+}
+
+int FacetTree::buildNode(std::vector<Tri>& tris, int first, int last) {
+    int index = (int)nodes.size();
+    nodes.push_back(Node());
+    Node node;
+    double lo[3], hi[3];
+    for (int c = 0; c < 3; c++)
+        lo[c] = hi[c] = tris[first].v[0][c];
+    double clo[3] = { 1.0e300, 1.0e300, 1.0e300 }, chi[3] = { -1.0e300, -1.0e300, -1.0e300 };
+    for (int i = first; i < last; i++) {
+        for (int c = 0; c < 3; c++) {
+            for (int k = 0; k < 3; k++) {
+                lo[c] = std::min(lo[c], tris[i].v[k][c]);
+                hi[c] = std::max(hi[c], tris[i].v[k][c]);
+            }
+            double centroid = tris[i].v[0][c] + tris[i].v[1][c] + tris[i].v[2][c];
+            clo[c] = std::min(clo[c], centroid);
+            chi[c] = std::max(chi[c], centroid);
+        }
+    }
+    for (int c = 0; c < 3; c++) {   // the corners are floats, the box is exact
+        node.lo[c] = lo[c];
+        node.hi[c] = hi[c];
+    }
+    if (last - first <= FACET_TREE_LEAF_SIZE) {
+        node.next  = first;
+        node.count = last - first;
+    } else {
+        // split at the median centroid along the longest axis of the centroids
+        int axis = 0;
+        for (int c = 1; c < 3; c++)
+            if (chi[c] - clo[c] > chi[axis] - clo[axis])
+                axis = c;
+        int mid = (first + last) / 2;
+        std::nth_element(tris.begin() + first, tris.begin() + mid, tris.begin() + last, CentroidLess(axis));
+        buildNode(tris, first, mid);
+        node.next  = buildNode(tris, mid, last);
+        node.count = 0;
+    }
+    nodes[index] = node;
+    return index;
+}
+
+float FacetTree::boxDist2(const Node& node, const float p[3]) {
+    float d2 = 0.0f;
+    for (int c = 0; c < 3; c++) {
+        float d = std::max( std::max(node.lo[c] - p[c], p[c] - node.hi[c]), 0.0f );
+        d2 += d * d;
+    }
+    return d2;
+}
+
+// closest point on a triangle, after Ericson, "Real-Time Collision Detection", 5.1.5.
+// the nearest point is a + s*(b-a) + t*(c-a); the divisions are replaced by the stored inverses.
+float FacetTree::facetDist2(int i, const float p[3], float r[3], FacetTable::Feature& feature) const {
+    float ab[3] = { table.abx[i], table.aby[i], table.abz[i] };
+    float ac[3] = { table.acx[i], table.acy[i], table.acz[i] };
+    float ap[3] = { p[0] - table.ax[i], p[1] - table.ay[i], p[2] - table.az[i] };
+    float d1 = ab[0]*ap[0] + ab[1]*ap[1] + ab[2]*ap[2];
+    float d2 = ac[0]*ap[0] + ac[1]*ap[1] + ac[2]*ap[2];
+    float s, t;
+    if (d1 <= 0.0f && d2 <= 0.0f) {
+        s = 0.0f; t = 0.0f;
+        feature = FacetTable::VERTEX_A;
+    } else {
+        float abab = ab[0]*ab[0] + ab[1]*ab[1] + ab[2]*ab[2];
+        float abac = ab[0]*ac[0] + ab[1]*ac[1] + ab[2]*ac[2];
+        float acac = ac[0]*ac[0] + ac[1]*ac[1] + ac[2]*ac[2];
+        float d3 = d1 - abab, d4 = d2 - abac;   // with b-p
+        float d5 = d1 - abac, d6 = d2 - acac;   // with c-p
+        float vc = d1*d4 - d3*d2, vb = d5*d2 - d1*d6, va = d3*d6 - d5*d4;
+        if (d3 >= 0.0f && d4 <= d3) {
+            s = 1.0f; t = 0.0f;
+            feature = FacetTable::VERTEX_B;
+        } else if (d6 >= 0.0f && d5 <= d6) {
+            s = 0.0f; t = 1.0f;
+            feature = FacetTable::VERTEX_C;
+        } else if (vc <= 0.0f && d1 >= 0.0f && d3 <= 0.0f) {
+            s = d1 * table.invAB[i]; t = 0.0f;
+            feature = FacetTable::EDGE_AB;
+        } else if (vb <= 0.0f && d2 >= 0.0f && d6 <= 0.0f) {
+            s = 0.0f; t = d2 * table.invAC[i];
+            feature = FacetTable::EDGE_CA;
+        } else if (va <= 0.0f && (d4 - d3) >= 0.0f && (d5 - d6) >= 0.0f) {
+            t = (d4 - d3) * table.invBC[i]; s = 1.0f - t;
+            feature = FacetTable::EDGE_BC;
+        } else {
+            s = vb * table.invN[i]; t = vc * table.invN[i];
+            feature = FacetTable::FACE;
+        }
+    }
+    for (int c = 0; c < 3; c++)
+        r[c] = ap[c] - s * ab[c] - t * ac[c];
+    return r[0]*r[0] + r[1]*r[1] + r[2]*r[2];
+}
+
+double FacetTree::dist(const GLVertex& v) const {
+    if (empty())
+        return -1.0;
+    float p[3] = { v.x, v.y, v.z };
+    float best = std::numeric_limits<float>::max();
+    float bestr[3] = { 0.0f, 0.0f, 0.0f };
+    int bestFacet = 0;
+    FacetTable::Feature bestFeature = FacetTable::FACE;
+
+    // depth-first, nearer child first, skipping the boxes beyond the nearest facet so far
+    std::pair<int, float> stack[64];
+    int top = 0;
+    stack[top++] = std::make_pair(0, boxDist2(nodes[0], p));
+    while (top) {
+        std::pair<int, float> s = stack[--top];
+        if (s.second >= best)
+            continue;
+        const Node& node = nodes[s.first];
+        if (node.count) {
+            for (int i = node.next; i < node.next + node.count; i++) {
+                float r[3];
+                FacetTable::Feature feature;
+                float d2 = facetDist2(i, p, r, feature);
+                if (d2 < best) {
+                    best = d2;
+                    bestr[0] = r[0]; bestr[1] = r[1]; bestr[2] = r[2];
+                    bestFacet = i;
+                    bestFeature = feature;
+                }
+            }
+        } else {
+            int l = s.first + 1, r = node.next;
+            float dl = boxDist2(nodes[l], p), dr = boxDist2(nodes[r], p);
+            if (dl < dr) {
+                std::swap(l, r);
+                std::swap(dl, dr);
+            }
+            if (dl < best) stack[top++] = std::make_pair(l, dl);
+            if (dr < best) stack[top++] = std::make_pair(r, dr);
+        }
+    }
+
+    const float* n = table.normals[bestFacet].n[bestFeature];
+    double unsignedDist = sqrt((double)best);
+    return ( bestr[0]*n[0] + bestr[1]*n[1] + bestr[2]*n[2] > 0.0f ) ? -unsignedDist : unsignedDist;  // positive inside
+}
+
+} // end namespace
+// end file facet_tree.cpp
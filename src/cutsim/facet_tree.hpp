@@ -0,0 +1,101 @@
+/*
+ *  Copyright 2015      Kazuyasu Hamada (k-hamada@gifu-u.ac.jp)
+ *
+ *  This file is part of OpenCAMlib.
+ *
+ *  OpenCAMlib is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  OpenCAMlib is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with OpenCAMlib.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef FACET_TREE_H
+#define FACET_TREE_H
+
+#include <iostream>
+#include <vector>
+
+#include "facet.hpp"
+
+namespace cutsim {
+
+/// the facets of a FacetTree in float32, one array per component, in the order of the tree leaves.
+/// A facet has the corners a, b and c.
+struct FacetTable {
+    /// the feature of a facet nearest to a point, indexing the pseudo-normals
+    enum Feature { FACE, EDGE_AB, EDGE_BC, EDGE_CA, VERTEX_A, VERTEX_B, VERTEX_C, FEATURES };
+    /// the pseudo-normals of the features of one facet
+    struct PseudoNormals {
+        float n[FEATURES][3];
+    };
+    /// allocate n facets
+    void resize(size_t n);
+    /// number of facets
+    size_t size() const { return ax.size(); }
+    /// corner a
+    std::vector<float> ax, ay, az;
+    /// edge b-a
+    std::vector<float> abx, aby, abz;
+    /// edge c-a
+    std::vector<float> acx, acy, acz;
+    /// 1/|b-a|^2, 1/|c-a|^2 and 1/|c-b|^2
+    std::vector<float> invAB, invAC, invBC;
+    /// 1/|(b-a) x (c-a)|^2
+    std::vector<float> invN;
+    /// read only for the nearest facet of a query
+    std::vector<PseudoNormals> normals;
+};
+
+/// bounding-volume hierarchy over the facets of an STL, for the signed distance of an StlVolume.
+///
+/// The distance is that to the nearest point of the nearest facet. Subtrees whose box is farther
+/// away than the nearest facet found so far are skipped, so a query visits a few leaves only.
+/// The sign is taken from the angle-weighted pseudo-normal of the nearest feature (the facet,
+/// one of its edges or one of its vertices), computed over the facets which share that feature.
+/// This is exact for a closed surface, also when the nearest point lies on an edge or a vertex.
+class FacetTree {
+    public:
+        FacetTree() {}
+        /// build the tree over facets. Degenerate facets are skipped.
+        void build(const std::vector<Facet>& facets);
+        /// signed distance from p to the facets, positive inside. -1 if there are no facets.
+        double dist(const GLVertex& p) const;
+        /// true if the tree holds no facets
+        bool empty() const { return table.size() == 0; }
+
+    protected:
+        /// a facet while the tree is built
+        struct Tri;
+        /// a node of the tree. The children of an inner node are at index+1 and at next.
+        struct Node {
+            /// box of the facets below this node
+            float lo[3], hi[3];
+            /// first facet of a leaf, or the second child of an inner node
+            int next;
+            /// number of facets of a leaf, 0 for an inner node
+            int count;
+        };
+        /// build the subtree over tris[first, last), return the index of its node
+        int buildNode(std::vector<Tri>& tris, int first, int last);
+        /// squared distance from p to the box of node
+        static float boxDist2(const Node& node, const float p[3]);
+        /// squared distance from p to facet i, and the vector r from the nearest point to p and its feature
+        float facetDist2(int i, const float p[3], float r[3], FacetTable::Feature& feature) const;
+
+        /// the facets, ordered so that each leaf holds a contiguous range
+        FacetTable table;
+        /// the nodes, in depth-first order. The root is nodes[0].
+        std::vector<Node> nodes;
+};
+
+} // end namespace
+#endif
+// end file facet_tree.hpp
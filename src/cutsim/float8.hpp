@@ -0,0 +1,167 @@
+/*
+ *  Copyright 2015      Kazuyasu Hamada (k-hamada@gifu-u.ac.jp)
+ *
+ *  This file is part of OpenCAMlib.
+ *
+ *  OpenCAMlib is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  OpenCAMlib is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with OpenCAMlib.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef FLOAT8_H
+#define FLOAT8_H
+
+#include <cmath>
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define FLOAT8_SSE
+#endif
+
+namespace cutsim {
+
+/// eight lanes of comparison results, one per lane of a Float8
+class Mask8 {
+    public:
+        Mask8() {}
+#if defined(__AVX__)
+        explicit Mask8(__m256 m) : v(m) {}
+        /// lane-wise and
+        Mask8 operator&(const Mask8& m) const { return Mask8( _mm256_and_ps(v, m.v) ); }
+        /// lane-wise or
+        Mask8 operator|(const Mask8& m) const { return Mask8( _mm256_or_ps(v, m.v) ); }
+        /// lane-wise not
+        Mask8 operator~() const { return Mask8( _mm256_xor_ps(v, _mm256_castsi256_ps( _mm256_set1_epi32(-1) )) ); }
+        /// bit n is set if lane n is true
+        unsigned int bits() const { return (unsigned int)_mm256_movemask_ps(v); }
+        /// all-ones in the true lanes
+        __m256 v;
+#elif defined(FLOAT8_SSE)
+        Mask8(__m128 l, __m128 h) : lo(l), hi(h) {}
+        /// lane-wise and
+        Mask8 operator&(const Mask8& m) const { return Mask8( _mm_and_ps(lo, m.lo), _mm_and_ps(hi, m.hi) ); }
+        /// lane-wise or
+        Mask8 operator|(const Mask8& m) const { return Mask8( _mm_or_ps(lo, m.lo), _mm_or_ps(hi, m.hi) ); }
+        /// lane-wise not
+        Mask8 operator~() const {
+            __m128 ones = _mm_castsi128_ps( _mm_set1_epi32(-1) );
+            return Mask8( _mm_xor_ps(lo, ones), _mm_xor_ps(hi, ones) );
+        }
+        /// bit n is set if lane n is true
+        unsigned int bits() const { return (unsigned int)( _mm_movemask_ps(lo) | (_mm_movemask_ps(hi) << 4) ); }
+        /// all-ones in the true lanes 0-3 and 4-7
+        __m128 lo, hi;
+#else
+        /// lane-wise and
+        Mask8 operator&(const Mask8& m) const { Mask8 r; for (int n=0;n<8;++n) r.b[n] = b[n] && m.b[n]; return r; }
+        /// lane-wise or
+        Mask8 operator|(const Mask8& m) const { Mask8 r; for (int n=0;n<8;++n) r.b[n] = b[n] || m.b[n]; return r; }
+        /// lane-wise not
+        Mask8 operator~() const { Mask8 r; for (int n=0;n<8;++n) r.b[n] = !b[n]; return r; }
+        /// bit n is set if lane n is true
+        unsigned int bits() const { unsigned int r = 0; for (int n=0;n<8;++n) r |= b[n] << n; return r; }
+        /// the lanes
+        bool b[8];
+#endif
+};
+
+/// eight single-precision lanes, evaluated at once in one AVX or two SSE registers.
+/// On other CPUs the lanes are a plain array and every operation loops over them.
+class Float8 {
+    public:
+        Float8() {}
+#if defined(__AVX__)
+        /// all lanes set to a
+        explicit Float8(float a) : v( _mm256_set1_ps(a) ) {}
+        explicit Float8(__m256 a) : v(a) {}
+        /// load eight lanes from p
+        static Float8 load(const float* p) { return Float8( _mm256_loadu_ps(p) ); }
+        /// store the lanes to p
+        void store(float* p) const { _mm256_storeu_ps(p, v); }
+        Float8 operator+(const Float8& a) const { return Float8( _mm256_add_ps(v, a.v) ); }
+        Float8 operator-(const Float8& a) const { return Float8( _mm256_sub_ps(v, a.v) ); }
+        Float8 operator*(const Float8& a) const { return Float8( _mm256_mul_ps(v, a.v) ); }
+        Float8 operator/(const Float8& a) const { return Float8( _mm256_div_ps(v, a.v) ); }
+        Float8 operator-() const { return Float8( _mm256_xor_ps(v, _mm256_set1_ps(-0.0f)) ); }
+        Mask8 operator<(const Float8& a)  const { return Mask8( _mm256_cmp_ps(v, a.v, _CMP_LT_OQ) ); }
+        Mask8 operator<=(const Float8& a) const { return Mask8( _mm256_cmp_ps(v, a.v, _CMP_LE_OQ) ); }
+        Mask8 operator>(const Float8& a)  const { return Mask8( _mm256_cmp_ps(v, a.v, _CMP_GT_OQ) ); }
+        Mask8 operator>=(const Float8& a) const { return Mask8( _mm256_cmp_ps(v, a.v, _CMP_GE_OQ) ); }
+        /// lane-wise square root
+        friend Float8 sqrt(const Float8& a) { return Float8( _mm256_sqrt_ps(a.v) ); }
+        /// a in the lanes where m is true, b elsewhere
+        friend Float8 select(const Mask8& m, const Float8& a, const Float8& b) { return Float8( _mm256_blendv_ps(b.v, a.v, m.v) ); }
+        /// the lanes
+        __m256 v;
+#elif defined(FLOAT8_SSE)
+        /// all lanes set to a
+        explicit Float8(float a) : lo( _mm_set1_ps(a) ), hi(lo) {}
+        Float8(__m128 l, __m128 h) : lo(l), hi(h) {}
+        /// load eight lanes from p
+        static Float8 load(const float* p) { return Float8( _mm_loadu_ps(p), _mm_loadu_ps(p + 4) ); }
+        /// store the lanes to p
+        void store(float* p) const { _mm_storeu_ps(p, lo); _mm_storeu_ps(p + 4, hi); }
+        Float8 operator+(const Float8& a) const { return Float8( _mm_add_ps(lo, a.lo), _mm_add_ps(hi, a.hi) ); }
+        Float8 operator-(const Float8& a) const { return Float8( _mm_sub_ps(lo, a.lo), _mm_sub_ps(hi, a.hi) ); }
+        Float8 operator*(const Float8& a) const { return Float8( _mm_mul_ps(lo, a.lo), _mm_mul_ps(hi, a.hi) ); }
+        Float8 operator/(const Float8& a) const { return Float8( _mm_div_ps(lo, a.lo), _mm_div_ps(hi, a.hi) ); }
+        Float8 operator-() const {
+            __m128 sign = _mm_set1_ps(-0.0f);
+            return Float8( _mm_xor_ps(lo, sign), _mm_xor_ps(hi, sign) );
+        }
+        Mask8 operator<(const Float8& a)  const { return Mask8( _mm_cmplt_ps(lo, a.lo), _mm_cmplt_ps(hi, a.hi) ); }
+        Mask8 operator<=(const Float8& a) const { return Mask8( _mm_cmple_ps(lo, a.lo), _mm_cmple_ps(hi, a.hi) ); }
+        Mask8 operator>(const Float8& a)  const { return Mask8( _mm_cmpgt_ps(lo, a.lo), _mm_cmpgt_ps(hi, a.hi) ); }
+        Mask8 operator>=(const Float8& a) const { return Mask8( _mm_cmpge_ps(lo, a.lo), _mm_cmpge_ps(hi, a.hi) ); }
+        /// lane-wise square root
+        friend Float8 sqrt(const Float8& a) { return Float8( _mm_sqrt_ps(a.lo), _mm_sqrt_ps(a.hi) ); }
+        /// a in the lanes where m is true, b elsewhere
+        friend Float8 select(const Mask8& m, const Float8& a, const Float8& b) {
+            return Float8( _mm_or_ps( _mm_and_ps(m.lo, a.lo), _mm_andnot_ps(m.lo, b.lo) ),
+                           _mm_or_ps( _mm_and_ps(m.hi, a.hi), _mm_andnot_ps(m.hi, b.hi) ) );
+        }
+        /// lanes 0-3 and 4-7
+        __m128 lo, hi;
+#else
+        /// all lanes set to a
+        explicit Float8(float a) { for (int n=0;n<8;++n) f[n] = a; }
+        /// load eight lanes from p
+        static Float8 load(const float* p) { Float8 r; for (int n=0;n<8;++n) r.f[n] = p[n]; return r; }
+        /// store the lanes to p
+        void store(float* p) const { for (int n=0;n<8;++n) p[n] = f[n]; }
+        Float8 operator+(const Float8& a) const { Float8 r; for (int n=0;n<8;++n) r.f[n] = f[n] + a.f[n]; return r; }
+        Float8 operator-(const Float8& a) const { Float8 r; for (int n=0;n<8;++n) r.f[n] = f[n] - a.f[n]; return r; }
+        Float8 operator*(const Float8& a) const { Float8 r; for (int n=0;n<8;++n) r.f[n] = f[n] * a.f[n]; return r; }
+        Float8 operator/(const Float8& a) const { Float8 r; for (int n=0;n<8;++n) r.f[n] = f[n] / a.f[n]; return r; }
+        Float8 operator-() const { Float8 r; for (int n=0;n<8;++n) r.f[n] = -f[n]; return r; }
+        Mask8 operator<(const Float8& a)  const { Mask8 r; for (int n=0;n<8;++n) r.b[n] = f[n] <  a.f[n]; return r; }
+        Mask8 operator<=(const Float8& a) const { Mask8 r; for (int n=0;n<8;++n) r.b[n] = f[n] <= a.f[n]; return r; }
+        Mask8 operator>(const Float8& a)  const { Mask8 r; for (int n=0;n<8;++n) r.b[n] = f[n] >  a.f[n]; return r; }
+        Mask8 operator>=(const Float8& a) const { Mask8 r; for (int n=0;n<8;++n) r.b[n] = f[n] >= a.f[n]; return r; }
+        /// lane-wise square root
+        friend Float8 sqrt(const Float8& a) { Float8 r; for (int n=0;n<8;++n) r.f[n] = std::sqrt(a.f[n]); return r; }
+        /// a in the lanes where m is true, b elsewhere
+        friend Float8 select(const Mask8& m, const Float8& a, const Float8& b) {
+            Float8 r; for (int n=0;n<8;++n) r.f[n] = m.b[n] ? a.f[n] : b.f[n]; return r;
+        }
+        /// the lanes
+        float f[8];
+#endif
+        /// lane-wise minimum
+        friend Float8 min(const Float8& a, const Float8& b) { return select(a < b, a, b); }
+};
+
+} // end namespace
+#endif
+// end file float8.hpp
@@ -19,13 +19,11 @@
 
 #include <iostream>
 #include <cassert>
-#include <set>
 #include <vector>
 
 #include <QtDebug>
 
 #include "gldata.hpp"
-#include "octnode.hpp"
 
 namespace cutsim {
 
@@ -33,6 +31,7 @@ GLData::GLData() {
     // some reasonable defaults...
     renderIndex = 0;
     workIndex = 1;
+    blockPolygons = 1;
     
     glp[workIndex].type = GL_TRIANGLES;
     glp[workIndex].polyVerts = 3;
@@ -42,106 +41,169 @@ GLData::GLData() {
     swap(); // to intialize glp etc.. (?)
 }
 
+/// add an empty block of polygons, return its index
+unsigned int GLData::addBlock() {
+    unsigned int block;
+    if ( !freeBlocks.empty() ) {
+        block = freeBlocks.back();
+        freeBlocks.pop_back();
+    } else {
+        block = blockDataArray.size();
+        blockDataArray.append( BlockData() );
+        for (unsigned int m=0;m<blockIndices();++m) {
+            indexArray[workIndex].append( 0 );
+            blockVertexArray.append( 0 );
+        }
+        touchIndices( block*blockIndices(), blockIndices() );
+    }
+    blockDataArray[block].polygons = 0;
+    blockDataArray[block].vertices = 0;
+    return block;
+}
+
+/// remove the polygons of the block, release its vertices and put it on the free list
+void GLData::removeBlock( unsigned int block ) {
+    BlockData& data = blockDataArray[block];
+    GLuint* idx = &indexArray[workIndex][ block*blockIndices() ];
+#ifdef MC_SHARED_VERTEX
+    if ( glp[workIndex].polyVerts == 3 ) {
+        for (unsigned int m=0;m<data.polygons;++m)
+            accumulateNormal( idx + 3*m, -1.0f );
+    }
+#endif
+    for (int m=0;m<data.polygons*glp[workIndex].polyVerts;++m)
+        idx[m] = 0; // degenerate, nothing is drawn
+    if ( data.polygons > 0 )
+        touchIndices( block*blockIndices(), data.polygons*glp[workIndex].polyVerts );
+    const GLuint* verts = &blockVertexArray[ block*blockIndices() ];
+    for (unsigned int m=0;m<data.vertices;++m)
+        releaseVertex( verts[m] );
+    data.polygons = 0;
+    data.vertices = 0;
+    freeBlocks.push_back( block );
+}
+
 /// add a vertex with given position and color, return its index
 unsigned int GLData::addVertex(float x, float y, float z, float r, float g, float b) {
-    return addVertex( GLVertex(x,y,z,r,g,b), NULL );
+    return addVertex( GLVertex(x,y,z,r,g,b) );
 }
 
-/// add vertex, associate given Octnode with the vertex, and return index
-unsigned int GLData::addVertex(GLVertex v, Octnode* n) {
-    // add vertex with empty polygon-list.
-    unsigned int idx = vertexArray[workIndex].size();
-    vertexArray[workIndex].append(v);
-    vertexDataArray.append( VertexData() );
-    vertexDataArray[idx].node = n;
+/// add vertex without users and return its index. Add it to a block with addBlockVertex().
+unsigned int GLData::addVertex(const GLVertex& v) {
+    unsigned int idx;
+    if ( !freeVertices.empty() ) {
+        idx = freeVertices.back();
+        freeVertices.pop_back();
+        vertexArray[workIndex][idx] = v;
+    } else {
+        idx = vertexArray[workIndex].size();
+        vertexArray[workIndex].append(v);
+        vertexDataArray.append( VertexData() );
+    }
+    touchVertices( idx );
+    vertexDataArray[idx].users = 0;
+#ifdef MC_SHARED_VERTEX
+    vertexDataArray[idx].key = 0;
+#endif
     assert( vertexArray[workIndex].size() == vertexDataArray.size() );
-    return idx; // return index of newly appended vertex
-}
-
-/// add vertex at given position
-unsigned int GLData::addVertex(float x, float y, float z, float r, float g, float b, Octnode* n) {
-    unsigned int id = addVertex(x,y,z,r,g,b);
-    vertexDataArray[id].node = n;
-    return id;
+    return idx;
 }
 
 /// set vertex normal
 void GLData::setNormal(unsigned int vertexIdx, float nx, float ny, float nz) {
     vertexArray[workIndex][vertexIdx].setNormal(nx,ny,nz);
+    touchVertices( vertexIdx );
 }
 
 /// modify given vertex
 void GLData::modifyVertex( unsigned int id, float x, float y, float z, float r, float g, float b, float nx, float ny, float nz) {
     GLVertex p = GLVertex(x,y,z,r,g,b,nx,ny,nz);
     vertexArray[workIndex][id] = p;
+    touchVertices( id );
 }
 
-/// remove vertex with given index
-void GLData::removeVertex( unsigned int vertexIdx ) {
-    // i) for each polygon of this vertex, call remove_polygon:
-    typedef std::set< unsigned int, std::greater<unsigned int> > PolygonSet;
-    PolygonSet pset = vertexDataArray[vertexIdx].polygons;
-    BOOST_FOREACH( unsigned int polygonIdx, pset ) {
-        removePolygon( polygonIdx );
-//std::cout << "Delete Polygon " << polygonIdx << "\n";
-    }
-    // ii) overwrite with last vertex:
-    unsigned int lastIdx = vertexArray[workIndex].size()-1;
-    if (vertexIdx != lastIdx) {
-        vertexArray[workIndex][vertexIdx] = vertexArray[workIndex][lastIdx];
-        vertexDataArray[vertexIdx] = vertexDataArray[lastIdx];
-        // notify octree-node with new index here!
-        // vertex that was at lastIdx is now at vertexIdx
-        vertexDataArray[vertexIdx].node->swapIndex( lastIdx, vertexIdx );
-
-        // request each polygon to re-number this vertex.
-        BOOST_FOREACH( unsigned int polygonIdx, vertexDataArray[vertexIdx].polygons ) {
-            unsigned int idx = polygonIdx*polygonVertices();
-            for (int m=0;m<polygonVertices();++m) {
-                if ( indexArray[workIndex][ idx+m ] == lastIdx )
-                    indexArray[workIndex][ idx+m ] = vertexIdx;
-            }
-        }
-    }
-    // shorten array
-    vertexArray[workIndex].resize( vertexArray[workIndex].size()-1 );
-    vertexDataArray.resize( vertexDataArray.size()-1 );
-    assert( vertexArray[workIndex].size() == vertexDataArray.size() );
-    //std::cout << " removeVertex done.\n";
+/// add the vertex to the vertices used by the block. It is released with the block.
+void GLData::addBlockVertex( unsigned int block, unsigned int vertexIdx ) {
+    BlockData& data = blockDataArray[block];
+    assert( data.vertices < blockIndices() );
+    blockVertexArray[ block*blockIndices() + data.vertices++ ] = vertexIdx;
+    vertexDataArray[vertexIdx].users++;
+}
+
+/// add a polygon of the vertices verts, which the block uses, to the next free slot of the block
+void GLData::addBlockPolygon( unsigned int block, const GLuint* verts ) {
+    BlockData& data = blockDataArray[block];
+    assert( data.polygons < blockPolygons );
+    unsigned int first = block*blockIndices() + data.polygons*glp[workIndex].polyVerts;
+    GLuint* idx = &indexArray[workIndex][first];
+    for (int m=0;m<glp[workIndex].polyVerts;++m)
+        idx[m] = verts[m];
+    touchIndices( first, glp[workIndex].polyVerts );
+    data.polygons++;
+#ifdef MC_SHARED_VERTEX
+    if ( glp[workIndex].polyVerts == 3 )
+        accumulateNormal( idx, 1.0f );
+#endif
 }
 
-/// add a polygon, return its index
-int GLData::addPolygon( std::vector<GLuint>& verts) {
-    // append to indexArray, then request each vertex to update
-    unsigned int polygonIdx = indexArray[workIndex].size()/polygonVertices();
-    BOOST_FOREACH( GLuint vertex, verts ) {
-        indexArray[workIndex].append(vertex);
-        vertexDataArray[vertex].addPolygon(polygonIdx); // add index to vertex i1
+void GLData::releaseVertex( unsigned int vertexIdx ) {
+    VertexData& data = vertexDataArray[vertexIdx];
+    assert( data.users > 0 );
+    if ( --data.users > 0 )
+        return;
+#ifdef MC_SHARED_VERTEX
+    if ( data.key ) {
+        sharedVertices.erase( data.key );
+        data.key = 0;
     }
-    return polygonIdx;
+#endif
+    freeVertices.push_back( vertexIdx );
 }
 
-/// remove polygon at given index
-void GLData::removePolygon( unsigned int polygonIdx) {
-    unsigned int idx = polygonVertices()*polygonIdx; // start-index for polygon
-    // i) request remove for each vertex in polygon:
-    for (int m=0; m<polygonVertices() ; ++m) // this polygon has the following 3/4 vertices. we call removePolygon on them all
-        vertexDataArray[ indexArray[workIndex][idx+m]   ].removePolygon(polygonIdx);
-    
-    unsigned int last_index = (indexArray[workIndex].size()-polygonVertices());
-    // if deleted polygon is last on the list, do nothing??
-    if (idx!=last_index) {
-        // ii) remove from polygon-list by overwriting with last element
-        for (int m=0; m<polygonVertices(); ++m)
-            indexArray[workIndex][idx+m  ] = indexArray[workIndex][ last_index+m   ];
-        // iii) for the moved polygon, request that each vertex update the polygon number
-        for (int m=0; m<polygonVertices() ; ++m) {
-            vertexDataArray[ indexArray[workIndex][idx+m   ] ].addPolygon( idx/polygonVertices() ); // this is the new polygon index
-            vertexDataArray[ indexArray[workIndex][idx+m   ] ].removePolygon( last_index/polygonVertices() ); // this polygon is no longer there!
+#ifdef MC_SHARED_VERTEX
+/// return the vertex with the given key. If there is none, add v as that vertex.
+/// The key identifies where the vertex lies, e.g. the octree edge, and is not 0.
+/// Each block which uses the vertex adds it with addBlockVertex().
+/// A shared vertex takes the color of v each time it is added, i.e. of the leaf updated last.
+unsigned int GLData::addSharedVertex(uint64_t key, const GLVertex& v) {
+    assert( key != 0 );
+    boost::unordered_map<uint64_t, unsigned int>::iterator found = sharedVertices.find( key );
+    if ( found != sharedVertices.end() ) {
+        GLVertex& shared = vertexArray[workIndex][ found->second ];
+        if ( shared.r != v.r || shared.g != v.g || shared.b != v.b ) {
+            shared.setColor( v.r, v.g, v.b );
+            touchVertices( found->second );
         }
+        return found->second;
     }
-    indexArray[workIndex].resize( indexArray[workIndex].size()-polygonVertices() ); // shorten array
-} 
+    unsigned int idx = addVertex( v );
+    vertexDataArray[idx].key = key;
+    vertexDataArray[idx].normal[0] = vertexDataArray[idx].normal[1] = vertexDataArray[idx].normal[2] = 0.0f;
+    sharedVertices[key] = idx;
+    return idx;
+}
+
+void GLData::accumulateNormal( const GLuint* triangle, GLfloat sign ) {
+    const GLVertex& p1 = vertexArray[workIndex][ triangle[0] ];
+    GLVertex n = (p1 - vertexArray[workIndex][ triangle[1] ]).cross( p1 - vertexArray[workIndex][ triangle[2] ] );
+    for (int m=0;m<3;++m) {
+        VertexData& data = vertexDataArray[ triangle[m] ];
+        if ( !data.key )
+            continue;
+        data.normal[0] += sign * n.x;
+        data.normal[1] += sign * n.y;
+        data.normal[2] += sign * n.z;
+        GLVertex& v = vertexArray[workIndex][ triangle[m] ];
+        if ( data.normal[0] != 0.0f || data.normal[1] != 0.0f || data.normal[2] != 0.0f )
+            v.setNormal( data.normal[0], data.normal[1], data.normal[2] );
+        else if ( n.x != 0.0 || n.y != 0.0 || n.z != 0.0 )
+            v.setNormal( n.x, n.y, n.z ); // the normals cancel, use the face normal rather than a stale one
+        else
+            continue;
+        touchVertices( triangle[m] );
+    }
+}
+#endif
 
 /// string output
 void GLData::print() {
@@ -167,7 +229,11 @@ void GLData::print() {
 	std::cout << "GLData indexArray(w) size: " << indexArray[workIndex].size() << " (" << indexArray[workIndex].size() * sizeof(GLuint) << " bytes)\n";
 	std::cout << "GLData vertexArray(r) size: " << vertexArray[renderIndex].size() << " (" << vertexArray[renderIndex].size() * sizeof(GLVertex) << " bytes)\n";
 	std::cout << "GLData indexArray(r) size: " << indexArray[renderIndex].size() << " (" << indexArray[renderIndex].size() * sizeof(GLuint) << " bytes)\n";
-	std::cout << "GLData vertexDataArray() size: " << vertexDataArray.size() << " (" << vertexDataArray.size() * sizeof(VertexData) << " bytes)\n";
+	std::cout << "GLData vertexDataArray() size: " << vertexDataArray.size() << " (" << vertexDataArray.size() * sizeof(VertexData) << " bytes), " << freeVertices.size() << " free\n";
+	std::cout << "GLData blocks: " << blockDataArray.size() << " of " << blockPolygons << " polygons, " << freeBlocks.size() << " free\n";
+#ifdef MC_SHARED_VERTEX
+	std::cout << "GLData shared vertices: " << sharedVertices.size() << "\n";
+#endif
 }
 
 } // end cutsim namespace
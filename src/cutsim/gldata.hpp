@@ -27,43 +27,38 @@
 #include <QMutexLocker>
 
 #include <iostream>
-#include <set>
+#include <cassert>
+#include <vector>
+#include <algorithm>
 #include <cmath>
+#include <stdint.h>
 
 #include <boost/foreach.hpp>
+#include <boost/unordered_map.hpp>
 
 #include "glvertex.hpp"
 
 namespace cutsim {
 
-class Octnode;
-
 /// additional vertex data not needed for OpenGL rendering
 /// but required for the isosurface or cutting-simulation algorithm.
 struct VertexData {
-    /// string output
-    void str() {
-        BOOST_FOREACH( GLuint pIdx, polygons ) {
-            std::cout << pIdx << " ";
-        }
-    }
-    /// insert polygon-id to polygon set
-    inline void addPolygon( unsigned int idx ) { polygons.insert( idx ); }
-    /// remove polygon-id from polygon set
-    inline void removePolygon(unsigned int idx ) { polygons.erase( idx ); }
-    /// is the polygon set empty?
-    inline bool empty() { return polygons.empty(); }
-// DATA
-    /// The set of polygons. Each polygon has an uint index which is stored here.
-    /// Note: we want to access polygons from highest index to lowest, thus compare with "greater"
-    typedef std::set< unsigned int, std::greater<unsigned int> > PolygonSet;
-    /// the polygons to which this vertex belongs. i.e. for each vertex we store in this set all the polygons to which it belongs.
-    PolygonSet polygons;
-    /// the Octnode that created this vertex. 
-    /// when an Octnode is cut the corresponding vertex/vertices are deleted.
-    /// when a vertex is deleted, the Octnode that generated it is notified
-    Octnode* node;
-    // (an alternative callback-mechanism would be to store a function-pointer or similar)
+    /// the number of blocks which use this vertex. A vertex without users is on the free list.
+    unsigned int users;
+#ifdef MC_SHARED_VERTEX
+    /// the key of a shared vertex, 0 for a vertex of one block only. See GLData::addSharedVertex().
+    uint64_t key;
+    /// sum of the area-weighted normals of the polygons at a shared vertex
+    GLfloat normal[3];
+#endif
+};
+
+/// a block of polygon slots owned by one Octnode
+struct BlockData {
+    /// number of polygons in the block, the remaining slots are degenerate
+    unsigned short polygons;
+    /// number of vertices used by the block
+    unsigned short vertices;
 };
 
 // the "secret sauce" paper suggests the following primitives
@@ -71,24 +66,24 @@ struct VertexData {
 //   or
 //   http://citeseerx.ist.psu.edu/viewdoc/summary?doi=10.1.1.13.2631
 //
-// - add vertex  
-//   add vertex with empty polygon list and pointer to octree-node
+// Here the polygons of an octree-node are kept together in a block of blockPolygons polygon slots
+// in the index-array, and the node only stores the number of its block.
+//
+// - add block
+//   take a block from the free list, or append one. All its polygons are degenerate.
 //
-// - remove vertex (also removes associated polygons)
-//   process list of polygons, from highest to lowest. call remove_polygon on each poly.
-//   overwrite with last vertex. shorten list. request each poly to re-number.
-// 
-// - add polygon DONE
-//   append new polygon to end of list, request each vertex to add new polygon to list.
+// - add vertex / add polygon
+//   the vertex is taken from the free list, or appended, and the block counts it as used.
+//   the polygon fills the next free slot of the block.
 //
-// - remove_polygon( polygonIndex ) 
-//   i) for each vertex: request remove this polygons index from list
-//   ii) then remove polygon from polygon-list: overwrite with last polygon, then shorten list.
-//   iii) process each vertex in the moved polygon, request renumber on each vert for this poly
+// - remove block
+//   overwrite the polygons with degenerate ones (all indices 0), release the vertices of the block
+//   and put the block on the free list. A vertex without users goes to the vertex free list.
+//   Nothing is moved, so no vertex- or polygon-index has to be renumbered.
 //
 // data structure:
-//  vertex-table: index, pos(x,y,z)  , polygons(id1,id2,...), Node-pointer to octree 
-// polygon-table: index, vertex-list
+//  vertex-table: index, pos(x,y,z), users
+//  block-table: index, polygon-count, vertex-list
 //
 
 /// \brief parameters for rendering held by a GLData.
@@ -121,14 +116,21 @@ class GLData {
 
 public:
     GLData();
+    /// the block of no Octnode
+    static const unsigned int NO_BLOCK = 0xffffffff;
+    unsigned int addBlock();
+    void removeBlock( unsigned int block );
     unsigned int addVertex(float x, float y, float z, float r, float g, float b);
-    unsigned int addVertex(GLVertex v, Octnode* n);
-    unsigned int addVertex(float x, float y, float z, float r, float g, float b, Octnode* n);
+    unsigned int addVertex(const GLVertex& v);
     void setNormal(unsigned int vertexIdx, float nx, float ny, float nz);
     void modifyVertex( unsigned int id, float x, float y, float z, float r, float g, float b, float nx, float ny, float nz);
-    void removeVertex( unsigned int vertexIdx );
-    int addPolygon( std::vector<GLuint>& verts);
-    void removePolygon( unsigned int polygonIdx);
+    void addBlockVertex( unsigned int block, unsigned int vertexIdx );
+    void addBlockPolygon( unsigned int block, const GLuint* verts );
+#ifdef MC_SHARED_VERTEX
+    unsigned int addSharedVertex(uint64_t key, const GLVertex& v);
+#endif
+    /// set the number of polygon slots of a block, before the first block is added
+    void setBlockPolygons(unsigned int n) { assert( blockDataArray.size() == 0 ); blockPolygons = n; }
     void print() ;
 
 // type of GLData
@@ -212,11 +214,11 @@ public:
         workMutex.unlock();
         renderMutex.unlock();
     }
-    /// copy render-buffer to work-buffer
+    /// copy render-buffer to work-buffer. Only the chunks changed since the last copy differ.
     void copyBuffers() { // rendering is allowed during this call, since we only read from [renderIndex] here
         workMutex.lock();
-            vertexArray[workIndex] = vertexArray[renderIndex];
-            indexArray[workIndex] = indexArray[renderIndex];
+            copyChunks( vertexArray[renderIndex], vertexArray[workIndex], dirtyVertexChunks, vertexChunkDirty );
+            copyChunks( indexArray[renderIndex], indexArray[workIndex], dirtyIndexChunks, indexChunkDirty );
             glp[workIndex] = glp[renderIndex];
         workMutex.unlock();
     }
@@ -231,8 +233,64 @@ protected:
     /// non-OpenGL data associated with vertices. This correspoinds allways to the workIndex.
     /// only one array, since not needed for OpenGL drawing!
     QVarLengthArray<VertexData>  vertexDataArray; 
-    /// polygon indices
+    /// polygon indices, in blocks of blockPolygons polygons
     QVarLengthArray<GLuint>      indexArray[2];
+    /// the polygon count and vertex count of each block. This corresponds to the workIndex.
+    QVarLengthArray<BlockData>   blockDataArray;
+    /// the vertices used by each block, as many slots per block as its polygons have indices
+    QVarLengthArray<GLuint>      blockVertexArray;
+    /// the removed blocks, for reuse
+    std::vector<unsigned int>    freeBlocks;
+    /// the vertices without users, for reuse
+    std::vector<unsigned int>    freeVertices;
+    /// number of polygon slots in a block
+    unsigned int blockPolygons;
+    /// number of indices in a block
+    unsigned int blockIndices() const { return blockPolygons*glp[workIndex].polyVerts; }
+    /// remove the block from the users of the vertex, and put the vertex on the free list if it was the last
+    void releaseVertex( unsigned int vertexIdx );
+#ifdef MC_SHARED_VERTEX
+    /// the index of each shared vertex by its key
+    boost::unordered_map<uint64_t, unsigned int> sharedVertices;
+    /// add sign times the area-weighted normal of the triangle to the normals of its shared vertices
+    void accumulateNormal( const GLuint* triangle, GLfloat sign );
+#endif
+    /// the chunks of vertexArray[workIndex] changed since the last copyBuffers()
+    std::vector<unsigned int> dirtyVertexChunks;
+    /// for each chunk of vertexArray[workIndex], is it in dirtyVertexChunks?
+    std::vector<bool> vertexChunkDirty;
+    /// the chunks of indexArray[workIndex] changed since the last copyBuffers()
+    std::vector<unsigned int> dirtyIndexChunks;
+    /// for each chunk of indexArray[workIndex], is it in dirtyIndexChunks?
+    std::vector<bool> indexChunkDirty;
+    /// mark the chunks of count elements from first as changed
+    static void touch( unsigned int first, unsigned int count, std::vector<unsigned int>& chunks, std::vector<bool>& dirty ) {
+        for (unsigned int c=first/GLDATA_CHUNK_SIZE; c<=(first+count-1)/GLDATA_CHUNK_SIZE; ++c) {
+            if ( c >= dirty.size() )
+                dirty.resize( c+1, false );
+            if ( !dirty[c] ) {
+                dirty[c] = true;
+                chunks.push_back(c);
+            }
+        }
+    }
+    /// mark count vertices from first as changed
+    void touchVertices( unsigned int first, unsigned int count=1 ) { touch( first, count, dirtyVertexChunks, vertexChunkDirty ); }
+    /// mark count indices from first as changed
+    void touchIndices( unsigned int first, unsigned int count ) { touch( first, count, dirtyIndexChunks, indexChunkDirty ); }
+    /// make to equal from, which differs only in the given chunks and its size
+    template <class T> static void copyChunks( const QVarLengthArray<T>& from, QVarLengthArray<T>& to,
+                                               std::vector<unsigned int>& chunks, std::vector<bool>& dirty ) {
+        to.resize( from.size() );
+        BOOST_FOREACH( unsigned int c, chunks ) {
+            int first = c*GLDATA_CHUNK_SIZE;
+            int last = std::min( first + GLDATA_CHUNK_SIZE, from.size() );
+            if ( first < last )
+                std::copy( from.data() + first, from.data() + last, to.data() + first );
+            dirty[c] = false;
+        }
+        chunks.clear();
+    }
     /// parameters for rendering this GLData
     GLParameters glp[2];
     
@@ -235,9 +235,8 @@ struct GLVertex {
         y = origin.y + result[1];
         z = origin.z + result[2];
     }
-    /// rotate vertex around A and C axis
-    GLVertex rotateAC(const GLfloat a, const GLfloat c) {
-        GLfloat M[3][3];
+    /// set M to the rotation matrix of rotateAC(a, c), for rotating many vertices with rotateAC(M)
+    static void rotationAC(const GLfloat a, const GLfloat c, GLfloat M[3][3]) {
         GLfloat zC = cos(c);
         GLfloat zS = sin(c);
         GLfloat xC = cos(a);
@@ -245,15 +244,15 @@ struct GLVertex {
         M[0][0] =  zC;       M[0][1] = -zS;       M[0][2] = 0.0;
         M[1][0] =  zS * xC;  M[1][1] =  zC * xC;  M[1][2] = -xS;
         M[2][0] =  zS * xS;  M[2][1] =  zC * xS;  M[2][2] =  xC;
-        // matrix multiply
-        GLVertex result;
-        result.x = x * M[0][0] + y * M[0][1];
-        result.y = x * M[1][0] + y * M[1][1] + z * M[1][2];
-        result.z = x * M[2][0] + y * M[2][1] + z * M[2][2];
-        return result;
+    }
+    /// rotate vertex around A and C axis
+    GLVertex rotateAC(const GLfloat a, const GLfloat c) const {
+        GLfloat M[3][3];
+        rotationAC(a, c, M);
+        return rotateAC(M);
     }
     /// rotate vertex by A and C rotation matrix
-    GLVertex rotateAC(const GLfloat M[3][3]) {
+    GLVertex rotateAC(const GLfloat M[3][3]) const {
         // matrix multiply
         GLVertex result;
         result.x = x * M[0][0] + y * M[0][1];
@@ -32,7 +32,7 @@ namespace cutsim {
 /// abstract base class for isosurface extraction algorithms
 /// 
 /// isosurface algorithms produce vertices and polygons based on an Octree
-/// vertices and polygons are added to a GLData using addVertex, addPolygon, etc.
+/// vertices and polygons are added to a block of the node in a GLData using addVertex, addBlockPolygon, etc.
 ///
 class IsoSurfaceAlgorithm {
 public:
@@ -57,12 +57,7 @@ protected:
     virtual void updateGL( Octnode* node) =0 ;
     /// when the given Octnode is deleted all associated GLData vertices are removed here.
     void remove_node_vertices(Octnode* current ) {
-        while( !current->vertexSetEmpty() ) {
-            unsigned int delId = current->vertexSetTop();
-            current->removeIndex( delId );
-            g->removeVertex( delId );
-        }
-        assert( current->vertexSetEmpty() ); // when done, set should be empty
+        current->clearBlock();
     }
     
     /// count the valid/invalid nodes, for debugging
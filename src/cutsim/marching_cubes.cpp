@@ -18,34 +18,104 @@
  *  along with OpenCAMlib.  If not, see <http://www.gnu.org/licenses/>.
 */
 
+#include <omp.h>
+
 #include "marching_cubes.hpp"
 
 namespace cutsim {
 
 void MarchingCubes::updateGL(Octnode* node) {
-    // traverse tree here and call polygonize_node
-//    if (node->valid())
-//        return;
-    
-//    if ( node->is_undecided() && node->isLeaf() ) {
-if ( !node->is_undecided() && !node->vertexSetEmpty())
-node->clearVertexSet();
-    if ( node->is_undecided() && node->isLeaf() && !node->valid()) {
-node->clearVertexSet();
-        mc_node(node);
-        node->setValid();
+    // clear all changed leaves before polygonizing one of them, so that a vertex shared between
+    // changed leaves is interpolated again instead of reused with the old distances
+    std::vector<Octnode*> changed;
+    clearInvalid(node, changed);
+    if ( parallel_leaves > 0 && changed.size() >= parallel_leaves ) {
+        mc_parallel(changed);
         return;
     }
-    
-    // current node done, now recurse into tree.
-    if ( node->childcount == 8 ) {
+    BOOST_FOREACH( Octnode* leaf, changed ) {
+        mc_node(leaf);
+        leaf->setValid();
+    }
+}
+
+// The boolean operations invalidate the nodes they change, and the path from them up to the root,
+// so a valid node has not changed since it was last polygonized and its subtree is skipped.
+void MarchingCubes::clearInvalid(Octnode* node, std::vector<Octnode*>& changed) {
+    if ( node->valid() )
+        return;
+    bool update = node->is_undecided() && node->isLeaf();
+    if ( node->hasBlock() && (!node->is_undecided() || update) )
+        node->clearBlock();
+    if ( update ) {
+        changed.push_back(node); // set valid once polygonized
+    } else if ( node->isLeaf() ) {
+        node->setValid();
+    } else if ( node->childcount == 8 ) {
+        bool children_valid = true;
         for (unsigned int m=0;m<8;m++) {
-//                if (!node->child[m]->valid())
-                    updateGL( node->child[m] );
+            clearInvalid( &node->child[m], changed );
+            children_valid = children_valid && node->child[m].valid();
         }
+        // invalidated by itself, with no change below it
+        if ( children_valid && !node->valid() )
+            node->setValid();
     }
 }
 
+// Each thread interpolates its leaves into its own buffer, without touching the GLData.
+// The triangles are then added leaf by leaf in the order of the serial loop, so the mesh
+// does not depend on the number of threads.
+void MarchingCubes::mc_parallel(const std::vector<Octnode*>& changed) {
+    const int count = changed.size();
+    std::vector<Cell> cells( count );
+    std::vector<Buffer> buffers( omp_get_max_threads() );
+#pragma omp parallel
+    {
+        unsigned int t = omp_get_thread_num();
+        Buffer& b = buffers[t];
+        GLVertex vertices[12];
+        uint64_t keys[12];
+#pragma omp for schedule(dynamic, 64)
+        for (int n=0;n<count;++n) {
+            assert( changed[n]->childcount == 0 );
+            assert( changed[n]->is_undecided() );
+            Cell& c = cells[n];
+            c.edgeTableIndex = mc_edgeTableIndex( changed[n] );
+            c.buffer = t;
+            c.first = b.vertices.size();
+            if (c.edgeTableIndex == 0 || c.edgeTableIndex == 0xff)
+                continue;
+            unsigned int nv = interpolated_vertices( changed[n], edgeTable[c.edgeTableIndex], vertices, keys );
+            b.vertices.insert( b.vertices.end(), vertices, vertices + nv );
+            b.keys.insert( b.keys.end(), keys, keys + nv );
+        }
+    }
+    for (int n=0;n<count;++n) {
+        const Cell& c = cells[n];
+        if (c.edgeTableIndex != 0 && c.edgeTableIndex != 0xff)
+            add_triangles( changed[n], c.edgeTableIndex, &buffers[c.buffer].vertices[c.first], &buffers[c.buffer].keys[c.first] );
+        changed[n]->setValid();
+    }
+}
+
+#ifdef MC_SHARED_VERTEX
+// The midpoint of an edge lies on the lattice. Along the edge it is an odd multiple of the half
+// side-length of the leaf and across it an even multiple, so it also tells the direction and length.
+uint64_t MarchingCubes::edgeKey(const Octnode* node, int idx1, int idx2) const {
+    int a[3], b[3];
+    node->getLatticeVertex(idx1, a);
+    node->getLatticeVertex(idx2, b);
+    // in units of the half side-length of the smallest leaves, 21 bits for each coordinate
+    const int shift = OCTREE_LATTICE_DEPTH + 1 - tree->max_depth;
+    assert( tree->max_depth <= 20 );
+    uint64_t key = 0;
+    for (int m=0;m<3;++m)
+        key = (key << 21) | (uint64_t)( ((a[m] + b[m]) / 2 + (1 << OCTREE_LATTICE_DEPTH)) >> shift );
+    return key; // not 0, the coordinate along the edge is odd
+}
+#endif
+
 /// run mc on one Octnode
 /// this generates one or more triangles which are pushed to the GLData
 void MarchingCubes::mc_node( Octnode* node) {
@@ -53,90 +123,104 @@ void MarchingCubes::mc_node( Octnode* node) {
     assert( node->is_undecided() );
     unsigned int edgeTableIndex = mc_edgeTableIndex(node);
  if (edgeTableIndex == 0 || edgeTableIndex == 0xff) return;
+    GLVertex vertices[12];
+    uint64_t keys[12];
+    interpolated_vertices( node, edgeTable[edgeTableIndex], vertices, keys );
+    add_triangles( node, edgeTableIndex, vertices, keys );
+}
+
+void MarchingCubes::add_triangles(Octnode* node, unsigned int edgeTableIndex, const GLVertex* vertices, const uint64_t* keys) {
+    // the index in vertices of the vertex on each edge
     unsigned int edges = edgeTable[edgeTableIndex];
-    std::vector< GLVertex > vertices = interpolated_vertices(node, edges);
+    int slot[12];
+    int nv = 0;
+    for (int e=0;e<12;++e)
+        slot[e] = (edges & (1 << e)) ? nv++ : -1;
+    unsigned int block = node->block();
+#ifdef MC_SHARED_VERTEX
+    // one vertex per edge, normals are accumulated by the GLData
+    GLuint ids[12];
+    for (int k=0;k<nv;++k) {
+        GLVertex p = vertices[k];
+        p.setColor( node->color );
+        ids[k] = g->addSharedVertex( keys[k], p );
+        g->addBlockVertex( block, ids[k] );
+    }
+    for (unsigned int i=0; triTable[edgeTableIndex][i] != -1 ; i+=3 ) {
+        GLuint triangle[3];
+        triangle[0] = ids[ slot[ triTable[edgeTableIndex][i    ] ] ];
+        triangle[1] = ids[ slot[ triTable[edgeTableIndex][i+1  ] ] ];
+        triangle[2] = ids[ slot[ triTable[edgeTableIndex][i+2  ] ] ];
+        g->addBlockPolygon( block, triangle );
+    }
+#else
     for (unsigned int i=0; triTable[edgeTableIndex][i] != -1 ; i+=3 ) {
-        std::vector< unsigned int > triangle;
-        GLVertex p1 = vertices[ triTable[edgeTableIndex][i    ] ];
-        GLVertex p2 = vertices[ triTable[edgeTableIndex][i+1  ] ];
-        GLVertex p3 = vertices[ triTable[edgeTableIndex][i+2  ] ];
+        GLuint triangle[3];
+        GLVertex p1 = vertices[ slot[ triTable[edgeTableIndex][i    ] ] ];
+        GLVertex p2 = vertices[ slot[ triTable[edgeTableIndex][i+1  ] ] ];
+        GLVertex p3 = vertices[ slot[ triTable[edgeTableIndex][i+2  ] ] ];
         GLVertex::set_normal_and_color( p1, p2, p3, node->color );
-        triangle.push_back( g->addVertex(  p1, node ) );
-        triangle.push_back( g->addVertex(  p2, node ) );
-        triangle.push_back( g->addVertex(  p3, node ) );
-        g->addPolygon(triangle);
-//std::cout << "Polygon Index " << g->addPolygon(triangle) << "\n";
-        node->addIndex( triangle[0] );
-        node->addIndex( triangle[1] );
-        node->addIndex( triangle[2] );
+        triangle[0] = g->addVertex( p1 );
+        triangle[1] = g->addVertex( p2 );
+        triangle[2] = g->addVertex( p3 );
+        for (int m=0;m<3;++m)
+            g->addBlockVertex( block, triangle[m] );
+        g->addBlockPolygon( block, triangle );
     }
+    (void)keys;
+#endif
 }
         
-std::vector<GLVertex> MarchingCubes::interpolated_vertices(const Octnode* node, unsigned int edges) {
-    std::vector<GLVertex> vertices(12);
-//    vertices[0] = *(node->vertex[0]); // intialize these to the node-vertex positions (?why?)
-//    vertices[1] = *(node->vertex[1]);
-//    vertices[2] = *(node->vertex[2]);
-//    vertices[3] = *(node->vertex[3]);
-//    vertices[4] = *(node->vertex[4]);
-//    vertices[5] = *(node->vertex[5]);
-//    vertices[6] = *(node->vertex[6]);
-//    vertices[7] = *(node->vertex[7]);
-    if ( edges & 0x001 )
-        vertices[0]  = interpolate( node, 0 , 1 );
-    if ( edges & 0x002 )
-        vertices[1]  = interpolate( node, 1 , 2 );
-    if ( edges & 0x004 )
-        vertices[2]  = interpolate( node, 2 , 3 );
-    if ( edges & 0x008 )
-        vertices[3]  = interpolate( node, 3 , 0 );
-    if ( edges & 0x010 )
-        vertices[4]  = interpolate( node, 4 , 5 );
-    if ( edges & 0x020 )
-        vertices[5]  = interpolate( node, 5 , 6 );
-    if ( edges & 0x040 )
-        vertices[6]  = interpolate( node, 6 , 7 );
-    if ( edges & 0x080 )
-        vertices[7]  = interpolate( node, 7 , 4 );
-    if ( edges & 0x100 )
-        vertices[8]  = interpolate( node, 0 , 4 );
-    if ( edges & 0x200 )
-        vertices[9]  = interpolate( node, 1 , 5 );
-    if ( edges & 0x400 )
-        vertices[10] = interpolate( node, 2 , 6 );
-    if ( edges & 0x800 )
-        vertices[11] = interpolate( node, 3 , 7 );
-    return vertices;
+unsigned int MarchingCubes::interpolated_vertices(const Octnode* node, unsigned int edges, GLVertex* vertices, uint64_t* keys) const {
+    unsigned int nv = 0;
+    for (int e=0;e<12;++e) {
+        if ( !(edges & (1 << e)) )
+            continue;
+        vertices[nv] = interpolate( node, edgeCorners[e][0], edgeCorners[e][1] );
+#ifdef MC_SHARED_VERTEX
+        keys[nv] = edgeKey( node, edgeCorners[e][0], edgeCorners[e][1] );
+#else
+        keys[nv] = 0;
+#endif
+        ++nv;
+    }
+    return nv;
 }
         
 /// use linear interpolation of the distance-field between vertices idx1 and idx2
 /// to generate a new iso-surface vertex on the idx1-idx2 edge
-GLVertex MarchingCubes::interpolate(const Octnode* node, int idx1, int idx2) {
+GLVertex MarchingCubes::interpolate(const Octnode* node, int idx1, int idx2) const {
     // p = p1 - f1 (p2-p1)/(f2-f1)
-    if (!( fabs(node->f[idx2] - node->f[idx1] ) > 1e-16 ))
-        std::cout << "mc::interpolate error " << node->f[idx2] << " and " << node->f[idx1] << " don't differ in sign!\n";
+    if (!( fabs(node->getF(idx2) - node->getF(idx1) ) > 1e-16 ))
+        std::cout << "mc::interpolate error " << node->getF(idx2) << " and " << node->getF(idx1) << " don't differ in sign!\n";
         
-    //assert( ( (node->f[idx2] * node->f[idx1] )  < 0 ) ); // should have unequal sign!
-    assert( fabs(node->f[idx2] - node->f[idx1] ) > 1e-16 );
-    return *(node->vertex[idx1]) -( *(node->vertex[idx2])-(*(node->vertex[idx1])) ) * 
-                                    (1.0/(node->f[idx2] - node->f[idx1])) *  node->f[idx1];
+    //assert( ( (node->getF(idx2) * node->getF(idx1) )  < 0 ) ); // should have unequal sign!
+    assert( fabs(node->getF(idx2) - node->getF(idx1) ) > 1e-16 );
+    GLVertex p1 = node->getVertex(idx1);
+    GLVertex p2 = node->getVertex(idx2);
+    return p1 - ( p2 - p1 ) * (1.0/(node->getF(idx2) - node->getF(idx1))) *  node->getF(idx1);
 }
 
 // based on the funcion values (positive or negative) at the corners of the node,
 // calculate the edgeTableIndex
-unsigned int MarchingCubes::mc_edgeTableIndex(const Octnode* node) {
+unsigned int MarchingCubes::mc_edgeTableIndex(const Octnode* node) const {
     unsigned int edgeTableIndex = 0;
-    if (node->f[0] < 0.0 ) edgeTableIndex |= 0x1;
-    if (node->f[1] < 0.0 ) edgeTableIndex |= 0x2;
-    if (node->f[2] < 0.0 ) edgeTableIndex |= 0x4;
-    if (node->f[3] < 0.0 ) edgeTableIndex |= 0x8;
-    if (node->f[4] < 0.0 ) edgeTableIndex |= 0x10;
-    if (node->f[5] < 0.0 ) edgeTableIndex |= 0x20;
-    if (node->f[6] < 0.0 ) edgeTableIndex |= 0x40;
-    if (node->f[7] < 0.0 ) edgeTableIndex |= 0x80;
+    if (node->getF(0) < 0.0 ) edgeTableIndex |= 0x1;
+    if (node->getF(1) < 0.0 ) edgeTableIndex |= 0x2;
+    if (node->getF(2) < 0.0 ) edgeTableIndex |= 0x4;
+    if (node->getF(3) < 0.0 ) edgeTableIndex |= 0x8;
+    if (node->getF(4) < 0.0 ) edgeTableIndex |= 0x10;
+    if (node->getF(5) < 0.0 ) edgeTableIndex |= 0x20;
+    if (node->getF(6) < 0.0 ) edgeTableIndex |= 0x40;
+    if (node->getF(7) < 0.0 ) edgeTableIndex |= 0x80;
     return edgeTableIndex;
 }
 
+// the corners of each edge, in the bit order of edgeTable
+const int MarchingCubes::edgeCorners[12][2] = {
+    {0, 1}, {1, 2}, {2, 3}, {3, 0}, {4, 5}, {5, 6}, {6, 7}, {7, 4}, {0, 4}, {1, 5}, {2, 6}, {3, 7}
+};
+
 // I think the tables are from http://paulbourke.net/geometry/polygonise/
 
 // this table stores indices into the triTable below, i.e. it tells
@@ -39,21 +39,55 @@ namespace cutsim {
 class MarchingCubes : public IsoSurfaceAlgorithm {
 public:
     /// create algorithm
-    MarchingCubes(GLData* gl, Octree* tr) : IsoSurfaceAlgorithm(gl,tr) {
+    MarchingCubes(GLData* gl, Octree* tr) : IsoSurfaceAlgorithm(gl,tr), parallel_leaves(DEFAULT_MC_PARALLEL_LEAVES) {
         g->setTriangles(); 
         g->setPolygonModeFill(); 
+        g->setBlockPolygons(5); // at most five triangles per cube
     }
     virtual ~MarchingCubes() { }
+    /// polygonize the changed leaves with parallel threads when there are at least n of them. 0 polygonizes serially.
+    void setParallelLeaves(unsigned int n) { parallel_leaves = n; }
 protected:
     void updateGL(Octnode* node);
+    /// remove the triangles of the leaves which need updating below node, and append these leaves to changed
+    void clearInvalid(Octnode* node, std::vector<Octnode*>& changed);
+    /// polygonize the leaves in changed with parallel threads, then add the triangles to the GLData in the order of changed
+    void mc_parallel(const std::vector<Octnode*>& changed);
+#ifdef MC_SHARED_VERTEX
+    /// key of the edge between corners idx1 and idx2 of node, the same for all leaves which share the edge
+    uint64_t edgeKey(const Octnode* node, int idx1, int idx2) const;
+#endif
+    /// the corners at the ends of each edge
+    static const int edgeCorners[12][2];
     void mc_node(Octnode* node); 
-    /// based on the f[] values, generate a list of interpolated vertices, all on the edges of the node.
-    /// These vertices are later used for defining triangles.
-    std::vector<GLVertex> interpolated_vertices(const Octnode* node, unsigned int edges) ;
-    GLVertex interpolate(const Octnode* node, int idx1, int idx2);
+    /// based on the f[] values, interpolate the vertices on the given edges of the node, in the order of the edges,
+    /// and with MC_SHARED_VERTEX their keys. Return the number of vertices.
+    /// Only reads the tree, so that leaves can be interpolated in parallel.
+    unsigned int interpolated_vertices(const Octnode* node, unsigned int edges, GLVertex* vertices, uint64_t* keys) const;
+    /// add the triangles of node for edgeTableIndex to the GLData, from the vertices of interpolated_vertices()
+    void add_triangles(Octnode* node, unsigned int edgeTableIndex, const GLVertex* vertices, const uint64_t* keys);
+    GLVertex interpolate(const Octnode* node, int idx1, int idx2) const;
 // DATA
     /// get table-index based on the funcion values (positive or negative) at the corners
-    unsigned int mc_edgeTableIndex(const Octnode* node);
+    unsigned int mc_edgeTableIndex(const Octnode* node) const;
+    /// the least number of changed leaves which are polygonized in parallel, 0 for never
+    unsigned int parallel_leaves;
+    /// a leaf polygonized by mc_parallel()
+    struct Cell {
+        /// the edgeTable index of the leaf
+        unsigned int edgeTableIndex;
+        /// the Buffer holding the vertices of the leaf
+        unsigned int buffer;
+        /// the index of the first vertex of the leaf in the Buffer
+        unsigned int first;
+    };
+    /// the vertices interpolated by one thread of mc_parallel()
+    struct Buffer {
+        /// the vertices of the leaves, in the order of interpolated_vertices()
+        std::vector<GLVertex> vertices;
+        /// the keys of the vertices
+        std::vector<uint64_t> keys;
+    };
     /// Marching-Cubes edge table
     static const unsigned int edgeTable[256];
     /// Marching-Cubes triangle table
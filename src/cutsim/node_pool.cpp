@@ -0,0 +1,231 @@
+/*
+ *  Copyright 2015      Kazuyasu Hamada (k-hamada@gifu-u.ac.jp)
+ *
+ *  This file is part of OpenCAMlib.
+ *
+ *  OpenCAMlib is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  OpenCAMlib is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with OpenCAMlib.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <cassert>
+#include <iostream>
+#include <new>
+
+#include <omp.h>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/mman.h>
+#endif
+
+#include "node_pool.hpp"
+
+namespace cutsim {
+
+// blocks kept in a per-thread free list before half of them go back to the slabs
+static const unsigned int THREAD_CACHE_MAX = 32;
+// blocks moved between a per-thread free list and the slabs at once
+static const unsigned int THREAD_CACHE_BATCH = 16;
+
+// round n up to a multiple of 16 bytes
+static size_t align16(size_t n) { return (n + 15) & ~(size_t)15; }
+
+NodePool::NodePool(size_t blockSize, size_t slabSize) {
+    stride = align16( sizeof(BlockHeader) + blockSize );
+    size_t head = align16( sizeof(Slab) );
+    blocksPerSlab = (slabSize > head + stride) ? (unsigned int)((slabSize - head) / stride) : 1;
+    slabBytes = head + blocksPerSlab * stride;
+    partial = NULL;
+    empty = NULL;
+    slabs = 0;
+    emptySlabs = 0;
+    used = 0;
+    cacheCount = omp_get_max_threads();
+    caches = new ThreadCache[cacheCount];
+    for (unsigned int t=0;t<cacheCount;++t)
+        caches[t].blocks.reserve( THREAD_CACHE_MAX + 1 );
+}
+
+NodePool::~NodePool() {
+    trim();
+    if (used != 0)
+        std::cout << " NodePool: " << used << " blocks still in use at destruction\n";
+    assert( used == 0 );
+    delete[] caches;
+}
+
+void* NodePool::allocate() {
+    BlockHeader* header;
+    ThreadCache* cache = threadCache();
+    if (cache) {
+        if (cache->blocks.empty()) {
+            mutex.lock();
+            for (unsigned int n=0;n<THREAD_CACHE_BATCH;++n)
+                cache->blocks.push_back( takeBlock() );
+            mutex.unlock();
+        }
+        header = cache->blocks.back();
+        cache->blocks.pop_back();
+        cache->lock.unlock();
+    } else {
+        mutex.lock();
+        header = takeBlock();
+        mutex.unlock();
+    }
+    return header + 1;
+}
+
+void NodePool::release(void* block) {
+    BlockHeader* header = static_cast<BlockHeader*>(block) - 1;
+    ThreadCache* cache = threadCache();
+    if (cache) {
+        cache->blocks.push_back(header);
+        if (cache->blocks.size() > THREAD_CACHE_MAX) {
+            mutex.lock();
+            for (unsigned int n=0;n<THREAD_CACHE_BATCH;++n) {
+                giveBlock( cache->blocks.back() );
+                cache->blocks.pop_back();
+            }
+            mutex.unlock();
+        }
+        cache->lock.unlock();
+    } else {
+        mutex.lock();
+        giveBlock(header);
+        mutex.unlock();
+    }
+}
+
+// the lock of a free list is always taken before the lock of the slabs
+void NodePool::trim() {
+    for (unsigned int t=0;t<cacheCount;++t) {
+        caches[t].lock.lock();
+        mutex.lock();
+        while (!caches[t].blocks.empty()) {
+            giveBlock( caches[t].blocks.back() );
+            caches[t].blocks.pop_back();
+        }
+        mutex.unlock();
+        caches[t].lock.unlock();
+    }
+    mutex.lock();
+    while (empty)
+        freeSlab(empty);
+    mutex.unlock();
+}
+
+// the per-thread lists are used in the outermost active parallel region. The OpenMP thread
+// number is the same in parallel regions started by other threads, or in an inactive region
+// nested inside, so a list held by another thread is passed over rather than waited for.
+NodePool::ThreadCache* NodePool::threadCache() {
+    if ( !omp_in_parallel() || omp_get_active_level() != 1 )
+        return NULL;
+    unsigned int t = omp_get_thread_num();
+    if (t >= cacheCount || !caches[t].lock.tryLock())
+        return NULL;
+    return &caches[t];
+}
+
+// fill partially used slabs first, so that the empty ones can be released
+NodePool::BlockHeader* NodePool::takeBlock() {
+    Slab* slab = partial;
+    if (slab == NULL) {
+        slab = empty ? empty : newSlab();
+        unlink(empty, slab);
+        emptySlabs--;
+        link(partial, slab);
+    }
+    BlockHeader* header = slab->freeList;
+    slab->freeList = header->next;
+    slab->freeCount--;
+    if (slab->freeCount == 0) // slab is full
+        unlink(partial, slab);
+    used++;
+    return header;
+}
+
+void NodePool::giveBlock(BlockHeader* header) {
+    Slab* slab = header->slab;
+    if (slab->freeCount == 0) // slab was full, it has a free block again
+        link(partial, slab);
+    header->next = slab->freeList;
+    slab->freeList = header;
+    slab->freeCount++;
+    used--;
+    if (slab->freeCount == blocksPerSlab) {
+        unlink(partial, slab);
+        link(empty, slab);
+        emptySlabs++;
+        // keep a few empty slabs around, so that nodes which are repeatedly
+        // split and merged do not map and unmap a slab each time
+        if (emptySlabs > 1 + slabs/8)
+            freeSlab(empty);
+    }
+}
+
+void NodePool::link(Slab*& list, Slab* slab) {
+    slab->prev = NULL;
+    slab->next = list;
+    if (list)
+        list->prev = slab;
+    list = slab;
+}
+
+void NodePool::unlink(Slab*& list, Slab* slab) {
+    if (slab->prev)
+        slab->prev->next = slab->next;
+    else
+        list = slab->next;
+    if (slab->next)
+        slab->next->prev = slab->prev;
+    slab->next = slab->prev = NULL;
+}
+
+NodePool::Slab* NodePool::newSlab() {
+#if defined(__unix__) || defined(__APPLE__)
+    void* memory = mmap(NULL, slabBytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (memory == MAP_FAILED)
+        throw std::bad_alloc();
+#else
+    void* memory = ::operator new(slabBytes);
+#endif
+    Slab* slab = static_cast<Slab*>(memory);
+    char* first = static_cast<char*>(memory) + align16( sizeof(Slab) );
+    slab->freeList = NULL;
+    for (unsigned int n=blocksPerSlab;n>0;--n) { // thread the free list so that blocks are handed out in address order
+        BlockHeader* header = reinterpret_cast<BlockHeader*>( first + (n-1)*stride );
+        header->slab = slab;
+        header->next = slab->freeList;
+        slab->freeList = header;
+    }
+    slab->freeCount = blocksPerSlab;
+    link(empty, slab);
+    slabs++;
+    emptySlabs++;
+    return slab;
+}
+
+// release an empty slab to the operating system
+void NodePool::freeSlab(Slab* slab) {
+    assert( slab->freeCount == blocksPerSlab );
+    unlink(empty, slab);
+    emptySlabs--;
+#if defined(__unix__) || defined(__APPLE__)
+    munmap(slab, slabBytes);
+#else
+    ::operator delete(slab);
+#endif
+    slabs--;
+}
+
+} // end namespace
+// end file node_pool.cpp
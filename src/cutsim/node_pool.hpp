@@ -0,0 +1,117 @@
+/*
+ *  Copyright 2015      Kazuyasu Hamada (k-hamada@gifu-u.ac.jp)
+ *
+ *  This file is part of OpenCAMlib.
+ *
+ *  OpenCAMlib is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  OpenCAMlib is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with OpenCAMlib.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef NODE_POOL_H
+#define NODE_POOL_H
+
+#include <cstddef>
+#include <vector>
+
+#include <QMutex>
+
+namespace cutsim {
+
+/// slab allocator for fixed-size blocks, used by one Octree for its blocks of eight child nodes.
+/// Blocks are carved out of large slabs. Each OpenMP thread number has a small free list with a
+/// lock of its own, so allocation inside a parallel region rarely takes the lock of the slabs.
+/// A slab whose blocks are all free is returned to the operating system.
+class NodePool {
+public:
+    /// create a pool of blocks of blockSize bytes, allocated in slabs of about slabSize bytes
+    NodePool(size_t blockSize, size_t slabSize);
+    /// release all slabs. All blocks must have been released before.
+    virtual ~NodePool();
+    /// return memory for one block
+    void* allocate();
+    /// return a block to the pool
+    void release(void* block);
+    /// move the blocks held in the per-thread free lists back to their slabs and release empty slabs
+    void trim();
+    /// number of slabs currently allocated
+    unsigned int slabCount() const { return slabs; }
+    /// number of blocks taken from the slabs (in use or held in the per-thread free lists)
+    unsigned int usedBlocks() const { return used; }
+    /// number of blocks in the allocated slabs
+    unsigned int capacity() const { return slabs * blocksPerSlab; }
+
+protected:
+    struct Slab;
+    /// header in front of every block, pointing to the slab it belongs to
+    struct BlockHeader {
+        Slab* slab;
+        /// next free block of the slab while the block is free
+        BlockHeader* next;
+    };
+    /// a slab of blocksPerSlab blocks, in the doubly-linked list of partially used or of empty slabs
+    struct Slab {
+        BlockHeader* freeList;
+        unsigned int freeCount;
+        Slab* prev;
+        Slab* next;
+    };
+    /// free list of an OpenMP thread number. Threads of different parallel regions may have the
+    /// same number, so it is locked as well.
+    struct ThreadCache {
+        QMutex lock;
+        std::vector<BlockHeader*> blocks;
+    };
+
+    /// take a block from a slab, creating a new slab if none has a free block. Lock must be held.
+    BlockHeader* takeBlock();
+    /// give a block back to its slab, releasing the slab when it becomes empty. Lock must be held.
+    void giveBlock(BlockHeader* header);
+    /// allocate and link a new slab. Lock must be held.
+    Slab* newSlab();
+    /// unlink and free an empty slab. Lock must be held.
+    void freeSlab(Slab* slab);
+    /// insert slab at the front of list
+    static void link(Slab*& list, Slab* slab);
+    /// remove slab from list
+    static void unlink(Slab*& list, Slab* slab);
+    /// return the locked free list of the calling thread, or NULL outside of a parallel region
+    /// or if another thread holds it
+    ThreadCache* threadCache();
+
+    /// distance in bytes between consecutive blocks, including the header
+    size_t stride;
+    /// bytes allocated per slab
+    size_t slabBytes;
+    /// number of blocks in a slab
+    unsigned int blocksPerSlab;
+    /// slabs which have both used and free blocks
+    Slab* partial;
+    /// slabs whose blocks are all free
+    Slab* empty;
+    /// number of allocated slabs
+    unsigned int slabs;
+    /// number of slabs in the empty list
+    unsigned int emptySlabs;
+    /// number of blocks taken from the slabs
+    unsigned int used;
+    /// per-thread free lists, indexed by OpenMP thread number
+    ThreadCache* caches;
+    /// number of per-thread free lists
+    unsigned int cacheCount;
+    /// protects the slabs
+    QMutex mutex;
+};
+
+} // end namespace
+#endif
+// end file node_pool.hpp
@@ -23,6 +23,7 @@
 #include <cassert>
 #include <iostream>
 #include <sstream>
+#include <new>
 
 #include <boost/foreach.hpp>
 
@@ -45,6 +46,17 @@ const GLVertex Octnode::direction[8] = {
                      GLVertex( 1,-1, 1)    // 7
 };
 
+const int Octnode::latticeDirection[8][3] = {
+                     { 1, 1,-1},   // 0
+                     {-1, 1,-1},   // 1
+                     {-1,-1,-1},   // 2
+                     { 1,-1,-1},   // 3
+                     { 1, 1, 1},   // 4
+                     {-1, 1, 1},   // 5
+                     {-1,-1, 1},   // 6
+                     { 1,-1, 1}    // 7
+};
+
 // surface enumeration
 // surf     vertices  vertices
 // 0:       2,3,7     2,6,7
@@ -80,7 +92,8 @@ Octnode::Octnode(Octnode* nodeparent, unsigned int index, double nodescale, unsi
     g = gl;
     
     if (parent) {
-        center = parent->childcenter(idx);
+        setChildLatticeIndex(parent, idx);
+        pool = parent->pool;
         state = parent->prev_state;
         prev_state = state;
         color = parent->color;
@@ -88,18 +101,17 @@ Octnode::Octnode(Octnode* nodeparent, unsigned int index, double nodescale, unsi
 					assert( parent == NULL );
     }
     
+    child = NULL;
     for ( int n=0;n<8;++n) {
-		child[n] = NULL;
-        vertex[n] = new GLVertex(*center + direction[n] * scale ) ;
             assert( parent->state == UNDECIDED );
             assert( parent->prev_state != UNDECIDED );
             //std::cout << parent->prev_state << "\n";
             if (parent->prev_state == INSIDE) {
-                f[n]=1;
+                setF(n, 1.0);
                 state = INSIDE;
             }
             else if (parent->prev_state == OUTSIDE) {
-                f[n]=-1;
+                setF(n, -1.0);
                 state = OUTSIDE;
             }
             else
@@ -109,93 +121,72 @@ Octnode::Octnode(Octnode* nodeparent, unsigned int index, double nodescale, unsi
              // sum() sum(): 0.15s + 0.27s   compared to 1.18 + 0.47
              // sum() diff(): 0.15 + 0.2     compared to 1.2 + 0.46
     }
-    bb.clear();
-#ifdef MULTI_AXIS
-// Multi Axis
-    bb.addPoint(*center + GLVertex(-2.0,-2.0,-2.0) * scale); // caluclate the minimum x,y,z coordinates
-    bb.addPoint(*center + GLVertex( 2.0, 2.0, 2.0) * scale); // caluclate the maximum x,y,z coordinates
-#else
-    bb.addPoint( *vertex[2] ); // vertex[2] has the minimum x,y,z coordinates
-    bb.addPoint( *vertex[4] ); // vertex[4] has the max x,y,z
-#endif
     isosurface_valid = false;
+    glBlock = GLData::NO_BLOCK;
 
     childcount = 0;
     childStatus = 0;
-alocation_count++;
+    shared = false;
+#pragma omp atomic
+    alocation_count++;
 }
 
 // For Root node
-Octnode::Octnode(GLVertex *root_center, double nodescale, GLData* gl) {
+Octnode::Octnode(const OctLattice* lat, NodePool* nodepool, double nodescale, GLData* gl) {
     parent = NULL;
     idx = 0;
     scale = nodescale;
     depth = 0;
     g = gl;
 
-    center = root_center;
+    lattice = lat;
+    pool = nodepool;
+    latticeIndex[0] = latticeIndex[1] = latticeIndex[2] = 0;
     state = UNDECIDED;
     prev_state = OUTSIDE;
 
+    child = NULL;
     for ( int n=0;n<8;++n) {
-        child[n] = NULL;
-        vertex[n] = new GLVertex(*center + direction[n] * scale) ;
-            f[n] = -1; 
+            setF(n, -1.0);
     }
-    bb.clear();
-#ifdef MULTI_AXIS
-// Multi Axis
-    bb.addPoint(*center + GLVertex(-2.0,-2.0,-2.0) * scale); // caluclate the minimum x,y,z coordinates
-    bb.addPoint(*center + GLVertex( 2.0, 2.0, 2.0) * scale); // caluclate the maximum x,y,z coordinates
-#else
-    bb.addPoint( *vertex[2] ); // vertex[2] has the minimum x,y,z coordinates
-    bb.addPoint( *vertex[4] ); // vertex[4] has the max x,y,z
-#endif
     isosurface_valid = false;
+    glBlock = GLData::NO_BLOCK;
     
     childcount = 0;
     childStatus = 0;
+    shared = false;
 
+#pragma omp atomic
     alocation_count++;
 }
 
-// call delete on children, vertices, and center
+// call delete on children
 Octnode::~Octnode() {
-//    if (childcount == 8 ) {
-    if (childcount != 0 ) {
-        for(int n=0;n<8;++n) {
-        	if (child[n]!=0) {
-        		if (child[n]->childcount != 0) {
-//std::cout << "\nchild[n]->childcount : " << child[n]->childcount << "\n";
-        			for (int m=0;m<8;++m)
-        				if (child[n]->child[m] != 0) {
-        					child[n]->child[m]->clearVertexSet();
-        					delete child[n]->child[m];
-        				}
-        			child[n]->childcount = 0;
-        		}
-        		assert( child[n]->childcount == 0);
-        		delete child[n];
-        		child[n] = 0;
-        		delete vertex[n];
-        		vertex[n] = 0;
-        	}
-        }
-    }
-    delete center;
-    center = 0;
+    if (child != NULL)
+        free_children();
 
+#pragma omp atomic
     delete_count++;
 }
 
-// return centerpoint of child with index n by pointer
-GLVertex* Octnode::childcenter(int n) {
-    return  new GLVertex(*center + ( direction[n] * 0.5*scale ));
+// destroy the children (and recursively their children) and release the child block
+void Octnode::free_children() {
+    assert( child != NULL );
+    for (int n=0;n<8;++n) {
+        child[n].clearBlock();
+        child[n].~Octnode();
+    }
+    releaseBlock(child);
+    child = NULL;
+    childcount = 0;
 }
 
-// return centerpoint of child with index n by value
-GLVertex Octnode::childcenterValue(int n) {
-    return  *center + ( direction[n] * 0.5*scale );
+// the center of child n is half a parent-half away from the parent center
+void Octnode::setChildLatticeIndex(const Octnode* nodeparent, int n) {
+    int h = nodeparent->latticeHalf() / 2;
+    lattice = nodeparent->lattice;
+    for (int m=0;m<3;++m)
+        latticeIndex[m] = nodeparent->latticeIndex[m] + latticeDirection[n][m] * h;
 }
 
 // create the 8 children of this node
@@ -205,13 +196,10 @@ void Octnode::subdivide() {
             std::cout << " subdivide() error: state==" << state << "\n";
 
         assert( state == UNDECIDED );
+        assert( depth < OCTREE_LATTICE_DEPTH ); // children must still lie on the lattice
+        child = allocateBlock();
         for( int n=0;n<8;++n ) {
-#ifdef POOL_NODE
-        	Octnode* newnode = createOctnode( this, n , scale*0.5 , depth+1 , g); // parent,  idx, scale,   depth, GLdata
-#else
-        	Octnode* newnode = new Octnode( this, n , scale*0.5 , depth+1 , g); // parent,  idx, scale,   depth, GLdata
-#endif
-            child[n] = newnode;
+            new (&child[n]) Octnode( this, n , scale*0.5 , depth+1 , g); // parent,  idx, scale,   depth, GLdata
             ++childcount;
         }
     } else {
@@ -220,46 +208,64 @@ void Octnode::subdivide() {
     }
 }
 
+void Octnode::getCorners(Corners& p) const {
+    int h = latticeHalf();
+    GLVertex lo = lattice->position( latticeIndex[0] - h, latticeIndex[1] - h, latticeIndex[2] - h );
+    GLVertex hi = lattice->position( latticeIndex[0] + h, latticeIndex[1] + h, latticeIndex[2] + h );
+    for (int n = 0; n < 8; ++n) {
+        p.x[n] = latticeDirection[n][0] < 0 ? lo.x : hi.x;
+        p.y[n] = latticeDirection[n][1] < 0 ? lo.y : hi.y;
+        p.z[n] = latticeDirection[n][2] < 0 ? lo.z : hi.z;
+    }
+}
+
 void Octnode::sum(const Volume* vol) {
-	double d;
+    Corners p;
+    double d[8];
+    getCorners(p);
+    vol->dist8(p, d);
     for (int n = 0; n < 8; ++n) {
-        if ((d = vol->dist(*(vertex[n]))) > f[n]) {
-            f[n] = d;
+        if ( raiseF(n, d[n]) )
             color = vol->color;
-         }
     }
     set_state();
 }
 
 void Octnode::diff(const Volume* vol) {
-	double d;
+    Corners p;
+    double d[8];
+    getCorners(p);
+    vol->dist8(p, d);
 	for (int n = 0; n < 8; ++n)  {
-        if ((d = -vol->dist(*(vertex[n]))) < f[n]) {
-            f[n] = d;
+        if ( lowerF(n, -d[n]) )
             color = vol->color;
-        }
     }
     set_state();
 }
 
 void Octnode::intersect(const Volume* vol) {
-	double d;
+    Corners p;
+    double d[8];
+    getCorners(p);
+    vol->dist8(p, d);
     for (int n = 0; n < 8; ++n) {
-        if ((d = vol->dist(*(vertex[n]))) < f[n])
+        if ( lowerF(n, d[n]) )
             color = vol->color;
-        f[n] = std::min<double>(f[n], d);
     }
     set_state();
 }
 
-CuttingStatus Octnode::diff_cd(const Volume* vol) {
-	Cutting r;
+CuttingStatus Octnode::diff_cd(const Volume* vol, double dmax) {
+	return diff_cd( (const CutterVolume*)vol, dmax );
+}
+
+CuttingStatus Octnode::lowerCorners(const Volume* vol, unsigned int active, const Cutting r[8]) {
 	CuttingStatus status = { 0, NO_COLLISION };
 	for (int n = 0; n < 8; ++n)  {
-		r = ((CutterVolume*)vol)->dist_cd(*(vertex[n]));
-		if (-r.f < f[n]) {
-            f[n] = -r.f;
-            status.collision |= r.collision;
+		if ( !(active & (1 << n)) )
+			continue;
+		if ( lowerF(n, -r[n].f) ) {
+            status.collision |= r[n].collision;
             if (color.isGray())
             	status.collision |= PARTS_COLLISION;
             status.cutcount++;
@@ -273,6 +279,15 @@ CuttingStatus Octnode::diff_cd(const Volume* vol) {
     return status;
 }
 
+void Octnode::diff_inside(const Volume* vol, double d) {
+    if (child != NULL)
+        free_children();
+    for (int n = 0; n < 8; ++n)
+        lowerF(n, -d);
+    color = vol->color;
+    set_state();
+}
+
 // look at the f-values in the corner of the cube and set state
 // to inside, outside, or undecided
 void Octnode::set_state() {
@@ -280,10 +295,10 @@ void Octnode::set_state() {
     bool outside = true;
     bool inside = true;
     for ( int n=0;n<8;n++) {
-        if ( f[n] >= 0.0 ) {// if one vertex is inside
+        if ( f[n] >= 0 ) {// if one vertex is inside
             outside = false; // then it's not an outside-node
         } else { // if one vertex is outside
-            assert( f[n] < 0.0 );
+            assert( f[n] < 0 );
             inside = false; // then it's not an inside node anymore
         }
     }
@@ -314,7 +329,7 @@ void Octnode::set_state() {
 void Octnode::setInside() {
     if ( (state!=INSIDE) && ( all_child_state(INSIDE)   ) ) {
         state = INSIDE;
-        if (parent && ( parent->state != INSIDE) )
+        if (parent && !parent->shared && ( parent->state != INSIDE) )
             parent->setInside();
     }
 }
@@ -322,7 +337,7 @@ void Octnode::setInside() {
 void Octnode::setOutside() {
     if ( (state!=OUTSIDE) && ( all_child_state(OUTSIDE)   ) )  {
         state = OUTSIDE;
-        if (parent && ( parent->state != OUTSIDE ) )
+        if (parent && !parent->shared && ( parent->state != OUTSIDE ) )
             parent->setOutside();
     }
 }
@@ -336,14 +351,14 @@ void Octnode::setUndecided() {
 
 bool Octnode::all_child_state(NodeState s) const {
     if ( childcount == 8 ) {
-        return (  child[0]->state == s ) && 
-                ( child[1]->state == s ) && 
-                ( child[2]->state == s ) && 
-                ( child[3]->state == s ) && 
-                ( child[4]->state == s ) && 
-                ( child[5]->state == s ) && 
-                ( child[6]->state == s ) && 
-                ( child[7]->state == s ) ;
+        return (  child[0].state == s ) && 
+                ( child[1].state == s ) && 
+                ( child[2].state == s ) && 
+                ( child[3].state == s ) && 
+                ( child[4].state == s ) && 
+                ( child[5].state == s ) && 
+                ( child[6].state == s ) && 
+                ( child[7].state == s ) ;
     } else {
         return true;
     }
@@ -351,36 +366,38 @@ bool Octnode::all_child_state(NodeState s) const {
 
 void Octnode::delete_children() {
     if (childcount==8) {
-        NodeState s0 = child[0]->state;
+        NodeState s0 = child[0].state;
         //std::cout << spaces() << depth << ":" << idx << " delete_children\n";
         //std::cout << "before: s0= " << s0 << " \n";
         //std::cout << " delete_children() states: ";
         //for ( int m=0;m<8;m++ ) {
-        //    std::cout << child[m]->state << " ";
+        //    std::cout << child[m].state << " ";
         //}
                 
         for (int n=0;n<8;n++) {
-            //std::cout << depth << " deleting " << n << "\n";
-            if ( s0 != child[n]->state ) {
+            if ( s0 != child[n].state ) {
                 std::cout << " delete_children() error: ";
                 //for ( int m=0;m<8;m++ ) {
-                //    std::cout << child[m]->state << " ";
+                //    std::cout << child[m].state << " ";
                 //}
                 std::cout << "\n";
                 std::cout << " s0= " << s0 << " \n";
             }
-            assert( s0 == child[n]->state );
-            child[n]->clearVertexSet();
-#ifdef POOL_NODE
-            deleteOctnode(child[n]);
-#else
-            delete child[n];
-#endif
-            child[n]=0;
-            childcount--;
+            assert( s0 == child[n].state );
         }
+        free_children();
         assert( childcount == 0);
-delete_childlen_count++;
+#pragma omp atomic
+        delete_childlen_count++;
+    }
+}
+
+void Octnode::join_children() {
+    if (childcount == 8) {
+        for (int m=0;m<8;++m) {
+            if ( !child[m].valid() )
+                setChildInvalid(m);
+        }
     }
 }
 
@@ -405,7 +422,7 @@ void Octnode::setChildInvalid( unsigned int id ) {
 
 void Octnode::setInvalid() { 
     isosurface_valid = false;
-    if ( parent && parent->valid() )  {// update parent status also
+    if ( parent && !parent->shared && parent->valid() )  {// update parent status also
         parent->setChildInvalid(idx);
     }
 }
@@ -414,38 +431,13 @@ bool Octnode::valid() const {
     return isosurface_valid;
 }
 
-void Octnode::addIndex(unsigned int id) { 
-#ifndef NDEBUG
-    std::set<unsigned int>::iterator found = vertexSet.find( id );
-    assert( found == vertexSet.end() ); // we should not have id
-#endif
-    vertexSet.insert(id); 
-}
-
-void Octnode::swapIndex(unsigned int oldId, unsigned int newId) {
-#ifndef NDEBUG
-    std::set<unsigned int>::iterator found = vertexSet.find(oldId);
-    assert( found != vertexSet.end() ); // we must have oldId
-#endif
-    vertexSet.erase(oldId);
-    vertexSet.insert(newId);
-}
-
-void Octnode::removeIndex(unsigned int id) {
-#ifndef NDEBUG
-    std::set<unsigned int>::iterator found = vertexSet.find( id );
-    assert( found != vertexSet.end() ); // we must have id
-#endif
-    vertexSet.erase(id);
-}
-
-void Octnode::clearVertexSet( ) {
-    while( !vertexSetEmpty() ) {
-        unsigned int delId = vertexSetTop();
-        removeIndex( delId );
-        g->removeVertex( delId );
-    }
-    assert( vertexSetEmpty() ); // when done, set should be empty
+// GLData is shared by the whole tree
+void Octnode::clearBlock( ) {
+    if ( !hasBlock() )
+        return;
+#pragma omp critical (gldata)
+    g->removeBlock( glBlock );
+    glBlock = GLData::NO_BLOCK;
 }
 
 // string repr
@@ -457,7 +449,7 @@ std::ostream& operator<<(std::ostream &stream, const Octnode &n) {
 std::string Octnode::printF() {
     std::ostringstream o;
     for (int n=0;n<8;n++) {
-        o << "f[" << n <<"] = " << f[n] << "\n";
+        o << "f[" << n <<"] = " << getF(n) << "\n";
     }
     return o.str();
 }
@@ -489,76 +481,23 @@ std::string Octnode::str() const {
     return o.str();
 }
 
+Octnode* Octnode::allocateBlock()
+{
 #ifdef POOL_NODE
+	return static_cast<Octnode*>( pool->allocate() );
+#else
+	return static_cast<Octnode*>( ::operator new( 8*sizeof(Octnode) ) );
+#endif
+}
 
-std::vector<Octnode*> nodePool;
-
-Octnode* Octnode::createOctnode(Octnode* nodeparent, unsigned int index, double nodescale, unsigned int nodedepth, GLData* gl)
-{
-	if (nodePool.size() != 0) {
-		Octnode* node = nodePool[nodePool.size()-1];
-		nodePool.resize(nodePool.size()-1);
-		node->parent = nodeparent;
-		node->idx = index;
-		node->scale = nodescale;
-		node->depth = nodedepth;
-		node->g = gl;
-	    if (node->parent) {
-			*node->center = node->parent->childcenterValue(node->idx);
-			node->state = node->parent->prev_state;
-			node->prev_state = node->state;
-			node->color = node->parent->color;
-	    } else { // node has no parent
-	    	assert( node->parent == NULL );
-	    }
-
-	    for ( int n=0;n<8;++n) {
-			node->child[n] = NULL;
-			*node->vertex[n] = *(node->center) + node->direction[n] * node->scale;
-	        if (node->parent) {
-	            assert( node->parent->state == UNDECIDED );
-	            assert( node->parent->prev_state != UNDECIDED );
-	            //std::cout << parent->prev_state << "\n";
-	            if (node->parent->prev_state == INSIDE) {
-	            	  node->f[n]=1;
-	                node->state = INSIDE;
-									}
-	            else if (node->parent->prev_state == OUTSIDE) {
-	            	node->f[n]=-1;
-	            	node->state = OUTSIDE;
-									}
-	            else
-	                assert(0);
-	        } else {
-	        	node->f[n] = -1;
-	        }
-	    }
-	 node->bb.clear();
-	#ifdef MULTI_AXIS
-	// Multi Axis
-	  node->bb.addPoint(*center + GLVertex(-2.0,-2.0,-2.0) * scale); // calculate the minimum x,y,z coordinates
-	  node->bb.addPoint(*center + GLVertex( 2.0, 2.0, 2.0) * scale); // calculate the maximum x,y,z coordinates
-	#else
-	  node->bb.addPoint( *vertex[2] ); // vertex[2] has the minimum x,y,z coordinates
-	  node->bb.addPoint( *vertex[4] ); // vertex[4] has the max x,y,z
-	#endif
-	  node->isosurface_valid = false;
-
-	  node->childcount = 0;
-	  node->childStatus = 0;
-
-	  return node;
-
-	} else
-	  return new Octnode( nodeparent, index , nodescale , nodedepth , gl);
-}
-
-void Octnode::deleteOctnode(Octnode* node)
+void Octnode::releaseBlock(Octnode* block)
 {
-   nodePool.push_back(node);
+#ifdef POOL_NODE
+	pool->release(block);
+#else
+	::operator delete(block);
+#endif
 }
 
-#endif //POOL_NODE
-
 } // end namespace
 // end of file octnode.cpp
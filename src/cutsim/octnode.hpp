@@ -29,9 +29,11 @@
 #include <vector>
 
 #include "volume.hpp"
+#include "cutter_kernel.hpp"
 #include "bbox.hpp"
 #include "glvertex.hpp"
 #include "gldata.hpp"
+#include "node_pool.hpp"
 
 namespace cutsim {
 
@@ -40,6 +42,24 @@ typedef struct cuttingStatus {
 	int collision;
 } CuttingStatus;
 
+/// integer lattice on which the center and the corner vertices of every Octnode lie.
+/// lattice index (0,0,0) is the root center and one lattice step is the half side-length
+/// of a node at depth OCTREE_LATTICE_DEPTH. Positions are computed from the index, so
+/// neighbouring nodes share their corners exactly without storing them.
+struct OctLattice {
+    OctLattice() : unit(0.0) {}
+    /// create a lattice centered at o for a root node with half side-length root_scale
+    OctLattice(const GLVertex& o, double root_scale) : origin(o), unit( root_scale / (double)(1 << OCTREE_LATTICE_DEPTH) ) {}
+    /// return the position of lattice index (i,j,k)
+    inline GLVertex position(int i, int j, int k) const {
+        return GLVertex( origin.x + i*unit, origin.y + j*unit, origin.z + k*unit );
+    }
+    /// position of lattice index (0,0,0)
+    GLVertex origin;
+    /// length of one lattice step
+    double unit;
+};
+
 /// \class Octnode
 /// Octnode represents a node in the octree.
 ///
@@ -51,15 +71,21 @@ class Octnode {
         /// node state, one of inside, outside, or undecided
         enum NodeState  { INSIDE, OUTSIDE, UNDECIDED };
         /// the current state of this node
-        NodeState state;
+        NodeState state : 2;
         /// previous state of this node
-        NodeState prev_state;
+        NodeState prev_state : 2;
+        /// the tree-dept of this node
+        unsigned int depth : 5; // depth of node
+        /// the index of this node [0,7]
+        unsigned int idx : 3; // index of node
+        /// number of children
+        unsigned int childcount : 4;
         /// the color of this node
         Color color;
         /// create suboctant idx of parent with scale nodescale and depth nodedepth
         Octnode(Octnode* parent, unsigned int idx, double nodescale, unsigned int nodedepth, GLData* g);
-        /// create root node
-        Octnode(GLVertex *root_center, double nodescale, GLData* gl);
+        /// create root node, centered at index (0,0,0) of the given lattice. Child blocks come from nodepool.
+        Octnode(const OctLattice* lat, NodePool* nodepool, double nodescale, GLData* gl);
         virtual ~Octnode();
         /// create all eight children of this node
         void subdivide(); 
@@ -74,8 +100,37 @@ class Octnode {
         void diff(const Volume* vol);
         /// intersect this node with given Volume
         void intersect(const Volume* vol);
-        /// diff Volume from this node with collision detection
-        CuttingStatus diff_cd(const Volume* vol);
+        /// diff Volume from this node with collision detection. The cutter distance at the corners
+        /// is at most dmax, corners whose value is already below -dmax are not evaluated.
+        CuttingStatus diff_cd(const Volume* vol, double dmax);
+        /// diff_cd() for a cutter of the type Cutter, whose kernel is called through cutterDist_cd8()
+        template <class Cutter> CuttingStatus diff_cd(const Cutter* vol, double dmax) {
+            Corners p;
+            Cutting r[8];
+            unsigned int active = 0;
+            for (int n = 0; n < 8; ++n) {
+                if ( getF(n) > -dmax ) // else the cutter cannot lower this corner
+                    active |= 1 << n;
+            }
+            if (active) {
+                getCorners(p);
+                cutterDist_cd8(vol, p, active, r);
+            }
+            return lowerCorners(vol, active, r);
+        }
+        /// this node lies inside Volume vol, at least the distance d from its surface.
+        /// remove the children and make the node outside without evaluating vol.
+        void diff_inside(const Volume* vol, double d);
+        /// bounds of the distance of Volume vol over this node, into lower and upper
+        void distBounds(const Volume* vol, double& lower, double& upper) const {
+            GLVertex c = getCenter(), h(scale, scale, scale);
+            vol->distBounds(c - h, c + h, lower, upper);
+        }
+        /// remove the children whatever their state, when an operation decides the whole node
+        void remove_children() {
+            if (child != NULL)
+                free_children();
+        }
         /// is this node outside?
         bool is_inside()    { return (state == INSIDE); }
         /// is this node outside?
@@ -87,6 +142,11 @@ class Octnode {
         bool all_child_state(NodeState s) const;
         /// delete all children of this node
         void delete_children();
+        /// pull the state of the children into this node, after a parallel traversal of the children
+        void join_children();
+        /// true while the children of this node are traversed by parallel tasks.
+        /// Changes in the children are then not propagated into this node, see join_children().
+        bool shared;
 
     // manipulate the valid-flag
         /// set valid-flag true
@@ -97,44 +157,111 @@ class Octnode {
         bool valid() const;
         
         /// true if this node has child n
-        inline bool hasChild(int n) { return (this->child[n] != NULL); }
+        inline bool hasChild(int n) { return (this->child != NULL) && ((unsigned int)n < childcount); }
         /// true if this node has no children
         inline bool isLeaf() { return (childcount == 0); }
+        /// half side-length of this node in lattice units
+        inline int latticeHalf() const { return 1 << (OCTREE_LATTICE_DEPTH - depth); }
+        /// return the position of corner vertex n
+        inline GLVertex getVertex(int n) const {
+            int h = latticeHalf();
+            return lattice->position( latticeIndex[0] + latticeDirection[n][0] * h,
+                                      latticeIndex[1] + latticeDirection[n][1] * h,
+                                      latticeIndex[2] + latticeDirection[n][2] * h );
+        }
+        /// store the lattice index of corner vertex n into idx
+        inline void getLatticeVertex(int n, int idx[3]) const {
+            int h = latticeHalf();
+            for (int m = 0; m < 3; ++m)
+                idx[m] = latticeIndex[m] + latticeDirection[n][m] * h;
+        }
+        /// store the eight corner vertices of this node into p
+        void getCorners(Corners& p) const;
+        /// return the center point of this node
+        inline GLVertex getCenter() const { return lattice->position( latticeIndex[0], latticeIndex[1], latticeIndex[2] ); }
+        /// true if the bounding-box of this node overlaps the bounding-box b of a volume
+        inline bool overlaps(const Bbox& b) const {
+#ifdef MULTI_AXIS
+            return b.overlapsCube( getCenter(), 2.0*scale ); // enlarged for rotated volumes
+#else
+            return b.overlapsCube( getCenter(), scale );
+#endif
+        }
+        /// true if this node overlaps the bounding-box b of a cutter, turned by the angle of the cutter
+        inline bool overlapsOriented(const Bbox& b) const {
+            return b.overlapsCubeOriented( getCenter(), scale );
+        }
+#ifdef COMPACT_NODE
+        /// the distance-field value at corner n
+        inline double getF(int n) const { return f[n] * fStep(); }
+        /// store the distance-field value d at corner n, rounded to a multiple of fStep()
+        inline void setF(int n, double d) {
+            double q = d / fStep();
+            if (q >= 32767.0)
+                f[n] = 32767;
+            else if (q <= -32767.0)
+                f[n] = -32767;
+            else if (d < 0.0 && q > -1.0)
+                f[n] = -1; // keep the sign, a negative value must stay outside
+            else
+                f[n] = (short)( q < 0.0 ? q - 0.5 : q + 0.5 );
+        }
+        /// the resolution of the stored distance-field. Values beyond COMPACT_NODE_RANGE*scale are clamped.
+        inline double fStep() const { return scale * (COMPACT_NODE_RANGE / 32767.0); }
+#else
+        /// the distance-field value at corner n
+        inline double getF(int n) const { return f[n]; }
+        /// store the distance-field value d at corner n
+        inline void setF(int n, double d) { f[n] = d; }
+#endif
+        /// lower the value at corner n to d. Returns true if the stored value changed.
+        inline bool lowerF(int n, double d) {
+            if ( d >= getF(n) )
+                return false;
+            double old = getF(n);
+            setF(n, d);
+            return getF(n) != old; // unchanged if d is clamped or below the resolution
+        }
+        /// raise the value at corner n to d. Returns true if the stored value changed.
+        inline bool raiseF(int n, double d) {
+            if ( d <= getF(n) )
+                return false;
+            double old = getF(n);
+            setF(n, d);
+            return getF(n) != old;
+        }
     // DATA
-        /// pointers to child nodes
-        Octnode* child[8];
+        /// block of the eight child nodes, stored contiguously in child-index order. NULL for a leaf.
+        Octnode* child;
         /// pointer to parent node
         Octnode* parent;
-        /// number of children
-        unsigned int childcount;
-        /// The eight corners of this node
-        GLVertex* vertex[8]; 
+#ifdef COMPACT_NODE
+        /// value of distance-field at corner vertex, in steps of fStep()
+        short f[8];
+#else
         /// value of distance-field at corner vertex
         double f[8]; 
-        /// the center point of this node
-        GLVertex* center; // the centerpoint of this node
-        /// the tree-dept of this node
-        unsigned int depth; // depth of node
-        /// the index of this node [0,7]
-        unsigned int idx; // index of node
+#endif
+        /// lattice index of the center point of this node
+        int latticeIndex[3];
+        /// the lattice on which the center and corners of this node lie
+        const OctLattice* lattice;
+        /// the pool of the tree, holding the child blocks
+        NodePool* pool;
         /// the scale of this node, i.e. distance from center out to corner vertices
         double scale; // distance from center to vertices
-        /// bounding-box corresponding to this node
-        Bbox bb;
     
-    // for manipulating vertexSet
-        /// add id to the vertex set
-        void addIndex(unsigned int id);
-        /// swap the id for an existing oldId to the given newId. This is called from GLData when GLData needs to move around vertices
-        void swapIndex(unsigned int oldId, unsigned int newId);
-        /// remove given id from vertex set
-        void removeIndex(unsigned int id);
-        /// is the vertex set empty?
-        bool vertexSetEmpty() {return vertexSet.empty(); }
-        /// return begin() for vertex set
-        unsigned int vertexSetTop() { return *(vertexSet.begin()); }
-        /// remove all vertices associated with this node. calls GLData to also remove nodes
-        void clearVertexSet();
+    // for manipulating the polygons of this node
+        /// has this node a block of polygons in the GLData?
+        bool hasBlock() const { return glBlock != GLData::NO_BLOCK; }
+        /// the block of polygons of this node in the GLData, created if there is none
+        unsigned int block() {
+            if ( !hasBlock() )
+                glBlock = g->addBlock();
+            return glBlock;
+        }
+        /// remove the block of polygons of this node, and the vertices only it uses, from the GLData
+        void clearBlock();
 
         /// string output
         friend std::ostream& operator<<(std::ostream &stream, const Octnode &o);
@@ -149,14 +276,12 @@ class Octnode {
         
         void force_setUndecided() { prev_state = state; state = UNDECIDED; }
 
-#ifdef POOL_NODE
-        Octnode* createOctnode(Octnode* nodeparent, unsigned int index, double nodescale, unsigned int nodedepth, GLData* gl);
-        void deleteOctnode(Octnode* node);
-#endif
 
     protected: 
         /// based on the f[]-values at the corners of this node, set the state to one of inside, outside, or undecided.
         void set_state();
+        /// lower the active corners by the cutter distances r and return the cutting status
+        CuttingStatus lowerCorners(const Volume* vol, unsigned int active, const Cutting r[8]);
         /// set node to inside
         void setInside();
         /// set node to outside
@@ -168,11 +293,16 @@ class Octnode {
         /// set the given child to invalid
         inline void setChildInvalid( unsigned int id );
 
-        /// the vertex indices that this node has produced. These correspond to vertex id's in the GLData.
-        std::set<unsigned int> vertexSet;
-        /// return center of child with index n
-        GLVertex* childcenter(int n); // return position of child centerpoint by pointer
-        GLVertex  childcenterValue(int n); // return position of child centerpoint by value
+        /// the block of the polygons that this node has produced in the GLData, or GLData::NO_BLOCK
+        unsigned int glBlock;
+        /// set the lattice index of this node to the center of child n of parent
+        void setChildLatticeIndex(const Octnode* parent, int n);
+        /// remove the GLData of the children and release the child block
+        void free_children();
+        /// return uninitialized memory for a block of eight nodes
+        Octnode* allocateBlock();
+        /// return the memory of a block of eight (destroyed) nodes
+        void releaseBlock(Octnode* block);
         /// The GLData, i.e. vertices and polygons, associated with this node
         /// when this node is deleted we notify the GLData that vertices should be removed
         GLData* g;
@@ -185,6 +315,8 @@ class Octnode {
 // STATIC
         /// the direction to the vertices, from the center 
         static const GLVertex direction[8];
+        /// the direction to the vertices, from the center, in lattice steps
+        static const int latticeDirection[8][3];
         /// bit masks for the status
         static const unsigned char octant[8];
 
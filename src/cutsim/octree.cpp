@@ -19,9 +19,11 @@
 */
 
 #include <list>
+#include <algorithm>
 #include <cassert>
 #include <iostream>
 #include <sstream>
+#include <typeinfo>
 
 #include <boost/foreach.hpp>
 
@@ -33,16 +35,16 @@ namespace cutsim {
 
 //**************** Octree ********************/
 
-Octree::Octree(double scale, unsigned int  depth, GLVertex* centerp, GLData* gl) {
+Octree::Octree(double scale, unsigned int  depth, GLVertex* centerp, GLData* gl)
+    : pool( 8*sizeof(Octnode), NODE_POOL_SLAB_SIZE ) {
     root_scale = scale;
     max_depth = depth;
     g = gl;
-    // parent(=root) scale, GLdata, center
-    root = new Octnode( centerp, root_scale, g );
+    lattice = OctLattice( *centerp, root_scale );
+    // lattice(=root center), scale, GLdata
+    root = new Octnode( &lattice, &pool, root_scale, g );
+    parallel_depth = DEFAULT_PARALLEL_DEPTH;
 
-    for ( int n=0;n<8;++n) {
-        root->child[n] = NULL;
-    }
     debug = false;
     debug_mc = false;
 }
@@ -88,7 +90,7 @@ void Octree::get_invalid_leaf_nodes(Octnode* current, std::vector<Octnode*>& nod
         for ( int n=0;n<8;++n) {
             if ( current->hasChild(n) ) {
                 if ( !current->valid() ) {
-                    get_leaf_nodes( current->child[n], nodelist );
+                    get_leaf_nodes( &current->child[n], nodelist );
                 }
             }
         }
@@ -101,8 +103,8 @@ void Octree::get_leaf_nodes(Octnode* current, std::vector<Octnode*>& nodelist) c
         nodelist.push_back( current );
     } else {
         for ( int n=0;n<8;++n) {
-            if ( current->child[n] != 0 )
-                get_leaf_nodes( current->child[n], nodelist );
+            if ( current->hasChild(n) )
+                get_leaf_nodes( &current->child[n], nodelist );
         }
     }
 }
@@ -112,29 +114,116 @@ void Octree::get_all_nodes(Octnode* current, std::vector<Octnode*>& nodelist) co
     if ( current ) {
         nodelist.push_back( current );
         for ( int n=0;n<8;++n) {
-            if ( current->child[n] != 0 )
-                get_all_nodes( current->child[n], nodelist );
+            if ( current->hasChild(n) )
+                get_all_nodes( &current->child[n], nodelist );
         }
     }
 }
 
+// The boolean operations run inside one parallel region. Above parallel_depth the eight children
+// of a node are traversed by separate tasks. Each task only modifies its own subtree: while the
+// children are traversed the node is marked shared, which stops the propagation of state and
+// validity from the children into it. After the tasks are done, join_children() catches up.
+
+void Octree::sum(const Volume* vol) {
+#pragma omp parallel if (parallel_depth > 0)
+#pragma omp single
+    sum( root, vol );
+}
+
+void Octree::diff(const Volume* vol) {
+#pragma omp parallel if (parallel_depth > 0)
+#pragma omp single
+    diff( root, vol );
+}
+
+void Octree::intersect(const Volume* vol) {
+#pragma omp parallel if (parallel_depth > 0)
+#pragma omp single
+    intersect( root, vol );
+}
+
+// terms of a CsgVolume applied in one traversal
+static const unsigned int CSG_BATCH_MAX = 64;
+
+void Octree::apply(const CsgVolume* csg) {
+    for (unsigned int first=0;first<csg->size();first+=CSG_BATCH_MAX) {
+        unsigned int count = std::min( CSG_BATCH_MAX, csg->size() - first );
+        uint64_t mask = (count == 64) ? ~(uint64_t)0 : (((uint64_t)1 << count) - 1);
+#pragma omp parallel if (parallel_depth > 0)
+#pragma omp single
+        apply( root, csg, first, mask );
+    }
+}
+
+CuttingStatus Octree::diff_c(const Volume* vol) {
+    return diff_cutter<CutterVolume>(vol);
+}
+
+template <class Cutter> CuttingStatus Octree::diff_cutter(const Volume* vol) {
+    const Cutter* cutter = static_cast<const Cutter*>(vol);
+    CuttingStatus status;
+#pragma omp parallel if (parallel_depth > 0)
+#pragma omp single
+    status = diff_c( root, cutter, false );
+    return status;
+}
+
+Octree::CutterDiff Octree::cutterDiff(const CutterVolume* cutter) {
+    if ( typeid(*cutter) == typeid(CylCutterVolume) )
+        return &Octree::diff_cutter<CylCutterVolume>;
+    else if ( typeid(*cutter) == typeid(BallCutterVolume) )
+        return &Octree::diff_cutter<BallCutterVolume>;
+    else
+        return &Octree::diff_cutter<CutterVolume>;
+}
+
+template <class Op> CuttingStatus Octree::visit_children(Octnode* current, const Op& op) {
+    CuttingStatus status = { 0, NO_COLLISION };
+    if ( current->depth < parallel_depth ) {
+        CuttingStatus childstatus[8];
+        current->shared = true;
+        for(int m=0;m<8;++m) {
+#pragma omp task firstprivate(m) shared(childstatus)
+            childstatus[m] = op( &current->child[m] );
+        }
+#pragma omp taskwait
+        current->shared = false;
+        current->join_children();
+        for(int m=0;m<8;++m) {
+            status.cutcount += childstatus[m].cutcount;
+            status.collision |= childstatus[m].collision;
+        }
+    } else {
+        for(int m=0;m<8;++m) {
+            CuttingStatus childstatus = op( &current->child[m] );
+            status.cutcount += childstatus.cutcount;
+            status.collision |= childstatus.collision;
+        }
+    }
+    return status;
+}
+
 // sum (union) of tree and Volume
 void Octree::sum(Octnode* current, const Volume* vol) {
-	if ( current->is_inside() || !vol->bb.overlaps( current->bb ) ) // if no overlap, or already INSIDE, then quit.
+	if ( current->is_inside() || !current->overlaps( vol->bb ) ) // if no overlap, or already INSIDE, then quit.
         return; // abort if no overlap.
-    
+    double lower, upper;
+    current->distBounds(vol, lower, upper);
+    if ( lower > 0.0 ) // the node lies inside vol, whatever its children are
+        current->remove_children();
+
     current->sum(vol);
+    if ( (lower > 0.0 || upper < 0.0) && (current->childcount == 0) && !current->is_undecided() )
+        return; // vol lies on one side of the whole node, new children would be pruned again
+    VolumeOp op = { this, &Octree::sum, vol };
     if ( (current->childcount == 8) ) { // recurse into existing tree
-        for(int m=0;m<8;++m) {
-            if ( !current->child[m]->is_inside()  ) // nodes that are already INSIDE cannot change in a sum-operation
-                sum( current->child[m], vol); // call sum on children
-        }
+        visit_children(current, op); // nodes that are already INSIDE cannot change in a sum-operation
     } else { // no children, subdivide it
         if ( (current->depth < (this->max_depth-1)) ) {
         	if (!current->is_undecided()) { current->force_setUndecided(); }
             current->subdivide(); // smash into 8 sub-pieces
-            for(int m=0;m<8;++m) 
-                sum( current->child[m], vol); // call sum on children
+            visit_children(current, op); // call sum on children
         }
     }
     // now all children of current have their status set, and we can prune.
@@ -147,25 +236,120 @@ void Octree::sum(Octnode* current, const Volume* vol) {
     }
 }
 
+// the terms of a CsgVolume, in turn. Each term is skipped or applied to the corners of current as by
+// sum(), diff() or intersect(), and the children are visited once with all the terms which continue
+// into them. Once a term continues into the children, current is an inner node for the later terms
+// and stays undecided until its children have been updated. New children start from the state and
+// the color current had after the first such term, as they would if each term was applied in a pass
+// of its own. A term which decides the whole node, by the bounds of its distance, removes the children.
+void Octree::apply(Octnode* current, const CsgVolume* csg, unsigned int first, uint64_t mask) {
+    uint64_t descend = 0; // the terms which continue into the children
+    Octnode::NodeState state = current->state, prev_state = current->prev_state;
+    Color color = current->color;
+    // the state of current may change before that of its children, keep it from the parent meanwhile
+    bool guard = current->parent && !current->parent->shared;
+    if (guard)
+        current->parent->shared = true;
+    for (unsigned int i=0;mask >> i;++i) {
+        if ( !(mask & ((uint64_t)1 << i)) )
+            continue;
+        const Volume* vol = csg->volume(first + i);
+        double lower, upper;
+        switch ( csg->operation(first + i) ) {
+        case CSG_SUM:
+            if ( current->is_inside() || !current->overlaps( vol->bb ) )
+                continue;
+            current->distBounds(vol, lower, upper);
+            if ( lower > 0.0 ) { // the earlier terms do not matter to the children
+                current->remove_children();
+                descend = 0;
+            }
+            current->sum(vol);
+            break;
+        case CSG_DIFF:
+            if ( current->is_outside() || !current->overlaps( vol->bb ) )
+                continue;
+            current->distBounds(vol, lower, upper);
+            if ( lower > 0.0 ) {
+                current->remove_children();
+                descend = 0;
+            }
+            current->diff(vol);
+            break;
+        case CSG_INTERSECT:
+            if ( current->is_outside() )
+                continue;
+            current->distBounds(vol, lower, upper);
+            if ( upper < 0.0 ) {
+                current->remove_children();
+                descend = 0;
+            }
+            current->intersect(vol);
+            if ( (current->childcount != 8) && !descend && !current->is_undecided() )
+                continue;
+            break;
+        }
+        bool inner = ( current->childcount == 8 ) || descend;
+        if ( !inner && (lower > 0.0 || upper < 0.0) && !current->is_undecided() )
+            continue; // the term lies on one side of the whole node, new children would be pruned again
+        if ( !inner ) {
+            if ( current->depth >= (this->max_depth-1) )
+                continue;
+            state = current->state;
+            prev_state = current->prev_state;
+            color = current->color;
+        }
+        descend |= (uint64_t)1 << i;
+        if (!current->is_undecided()) { current->force_setUndecided(); }
+    }
+    if (guard) {
+        current->parent->shared = false;
+        if ( !current->valid() )
+            current->setInvalid(); // pass on to the parent, which was kept from it above
+    }
+    if ( descend ) {
+        if ( current->childcount != 8 ) { // no children, subdivide it
+            std::swap( current->color, color );
+            current->state = state;
+            current->prev_state = prev_state;
+            if (!current->is_undecided()) { current->force_setUndecided(); }
+            current->subdivide(); // smash into 8 sub-pieces
+            std::swap( current->color, color );
+        }
+        ApplyOp op = { this, csg, first, descend };
+        visit_children(current, op);
+    }
+    // now all children of current have their status set, and we can prune.
+    if ( (current->childcount == 8) && ( current->all_child_state(Octnode::INSIDE) || current->all_child_state(Octnode::OUTSIDE) ) ) {
+    	if (current->all_child_state(Octnode::INSIDE))
+    		current->state = Octnode::INSIDE;
+    	else
+    		current->state = Octnode::OUTSIDE;
+        current->delete_children();
+    }
+}
+
 // diff (intersection with volume's compliment) of tree and Volume
 void Octree::diff(Octnode* current, const Volume* vol) {
-	if ( current->is_outside() || !vol->bb.overlaps( current->bb ) ) // if no overlap, or already OUTSIDE, then return.
+	if ( current->is_outside() || !current->overlaps( vol->bb ) ) // if no overlap, or already OUTSIDE, then return.
     	return;
+    double lower, upper;
+    current->distBounds(vol, lower, upper);
+    if ( lower > 0.0 ) // the node lies inside vol, whatever its children are
+        current->remove_children();
 
     current->diff(vol);
+    if ( (lower > 0.0 || upper < 0.0) && (current->childcount == 0) && !current->is_undecided() )
+        return; // vol lies on one side of the whole node, new children would be pruned again
+    VolumeOp op = { this, &Octree::diff, vol };
     if ( ((current->childcount) == 8) /*&& current->is_undecided()*/ ) { // recurse into existing tree
-         for(int m=0;m<8;++m) {
-            //if ( !current->child[m]->is_outside()  ) // nodes that are OUTSIDE don't change
-                diff( current->child[m], vol); // call diff on children
-        }
+        visit_children(current, op); // call diff on children
     } else { // no children, subdivide it
 
         if ( (current->depth < (this->max_depth-1)) ) {
         	if (!current->is_undecided()) { current->force_setUndecided(); }
             current->subdivide(); // smash into 8 sub-pieces
-            for(int m=0;m<8;++m) {
-                diff( current->child[m], vol); // call diff on children
-            }
+            visit_children(current, op); // call diff on children
         }
     }
     // now all children have their status set, prune.
@@ -179,20 +363,20 @@ void Octree::diff(Octnode* current, const Volume* vol) {
 void Octree::intersect(Octnode* current, const Volume* vol) {
     if ( current->is_outside() ) // if already OUTSIDE, then return.
         return;   
-    
+    double lower, upper;
+    current->distBounds(vol, lower, upper);
+    if ( upper < 0.0 ) // the node lies outside vol, whatever its children are
+        current->remove_children();
+
     current->intersect(vol);
+    VolumeOp op = { this, &Octree::intersect, vol };
     if ( ((current->childcount) == 8) && current->is_undecided() ) { // recurse into existing tree
-        for(int m=0;m<8;++m) {
-            //if ( !current->child[m]->is_outside()  ) // nodes that are OUTSIDE don't change
-                intersect( current->child[m], vol); // call diff on children
-        }
+        visit_children(current, op); // call intersect on children
     } else if (  current->is_undecided() ) { // no children, subdivide if undecided 
     	if (current->childcount != 0) { std::cout << " current->childcount != 0 now:" << current->childcount; return; }
         if ( (current->depth < (this->max_depth-1)) ) {
             current->subdivide(); // smash into 8 sub-pieces
-            for(int m=0;m<8;++m) {
-                intersect( current->child[m], vol); // call diff on children
-            }
+            visit_children(current, op); // call intersect on children
         }
     }
     // now all children have their status set, prune.
@@ -201,33 +385,105 @@ void Octree::intersect(Octnode* current, const Volume* vol) {
     }
 }
 
-// diff (intersection with volume's compliment) of tree and Volume for cuttings
-CuttingStatus Octree::diff_c(Octnode* current, const Volume* vol) {
+/// how a cutter reaches a node: not at all, with its neck, shank or holder only, or with its flutes
+enum CutterReach { REACH_NONE, REACH_COLLISION, REACH_FLUTES };
+
+// bb holds the segment boxes, so a node outside both bb and bbHolder is not reached
+static inline CutterReach cutterReach(const Octnode* node, const CutterVolume* vol) {
+	bool holder = vol->enableholder && node->overlapsOriented( vol->bbHolder );
+	if ( !holder && !node->overlapsOriented( vol->bb ) )
+		return REACH_NONE;
+	if ( node->overlapsOriented( vol->bbSegment[FLUTE_SEGMENT] ) )
+		return REACH_FLUTES;
+	if ( holder )
+		return REACH_COLLISION;
+	for (int s=NECK_SEGMENT;s<CUTTER_SEGMENTS;++s) {
+		if ( vol->hasSegment(s) && node->overlapsOriented( vol->bbSegment[s] ) )
+			return REACH_COLLISION;
+	}
+	return REACH_NONE;
+}
+
+// the corners of the leaves of max_depth which diff_cd() would lower with a collision.
+// The search stays in the existing tree: a leaf above max_depth which the cutter reaches is taken as
+// filled with material where the cutter is, diff_c() would subdivide it and decide there.
+template <class Cutter> bool Octree::collides(const Octnode* current, const Cutter* vol) const {
+	if ( current->state == Octnode::OUTSIDE || cutterReach(current, vol) == REACH_NONE )
+		return false;
+	if ( current->childcount == 8 ) {
+		for (int m=0;m<8;++m) {
+			if ( collides( &current->child[m], vol ) )
+				return true;
+		}
+		return false;
+	}
+	double fc, bound;
+	if ( vol->cull( current->getCenter(), sqrt(3.0) * current->scale, fc, bound ) == CULL_OUTSIDE )
+		return false;
+	if ( current->depth < (this->max_depth-1) )
+		return true;
+	Corners p;
+	Cutting r[8];
+	unsigned int active = 0;
+	for (int n=0;n<8;++n) {
+		if ( current->getF(n) > -(fc + bound) )
+			active |= 1 << n;
+	}
+	if ( !active )
+		return false;
+	current->getCorners(p);
+	cutterDist_cd8(vol, p, active, r);
+	for (int n=0;n<8;++n) {
+		if ( (active & (1 << n)) && r[n].collision && -r[n].f < current->getF(n) )
+			return true;
+	}
+	return false;
+}
+
+// diff (intersection with volume's compliment) of tree and Volume for cuttings.
+// Where only the neck, shank or holder reach the node, nothing is cut unless they collide with the material.
+// collided is set below a node where collides() was true, the children need not search again.
+template <class Cutter> CuttingStatus Octree::diff_c(Octnode* current, const Cutter* vol, bool collided) {
 	CuttingStatus status = { 0, NO_COLLISION }, childstatus;
-	if ( current->is_outside() || (!vol->bb.overlaps( current->bb ) && (!((CutterVolume*)vol)->enableholder || !((CutterVolume*)vol)->bbHolder.overlaps( current->bb ))) )
-    	return status;
+	if ( current->is_outside() )
+		return status;
+	CutterReach reach = cutterReach( current, vol );
+	if ( reach == REACH_NONE )
+		return status;
+	if ( reach == REACH_COLLISION && !collided ) {
+		if ( !collides( current, vol ) )
+			return status;
+		collided = true;
+	}
+
+	// classify the whole node by the distance at its center, before evaluating the corners
+	double fc, bound;
+	CutterCull cull = vol->cull( current->getCenter(), sqrt(3.0) * current->scale, fc, bound );
+	if ( cull == CULL_OUTSIDE )
+		return status;
+	if ( cull == CULL_INSIDE ) {
+		status = removed_status(current);
+		current->diff_inside( vol, fc - bound );
+		return status;
+	}
 
     if (current->depth == (this->max_depth-1))
-    	status = current->diff_cd(vol);
+    	status = current->diff_cd(vol, fc + bound);
     else
     	current->diff(vol);
+    DiffOp<Cutter> op = { this, vol, collided };
     if ( ((current->childcount) == 8) /*&& current->is_undecided()*/ ) { // recurse into existing tree
-         for(int m=0;m<8;++m) {
-            //if ( !current->child[m]->is_outside()  ) // nodes that are OUTSIDE don't change
-        	 childstatus = diff_c( current->child[m], vol); // call diff on children
-        	 status.cutcount += childstatus.cutcount;
-        	 status.collision |= childstatus.collision;
-        }
+        childstatus = visit_children(current, op); // call diff on children
+        status.cutcount += childstatus.cutcount;
+        status.collision |= childstatus.collision;
     } else { // no children, subdivide it
 
 		if ( (current->depth < (this->max_depth-1)) ) {
 			if (!current->is_undecided()) { current->force_setUndecided(); }
 			current->subdivide(); // smash into 8 sub-pieces
-			for(int m=0;m<8;++m) {
-				childstatus = diff_c( current->child[m], vol); // call diff on children
-				status.cutcount += childstatus.cutcount;
-				status.collision |= childstatus.collision;
-			}
+			childstatus = visit_children(current, op); // call diff on children
+			status.cutcount += childstatus.cutcount;
+			status.collision |= childstatus.collision;
 		}
     }
     // now all children have their status set, prune.
@@ -238,9 +494,24 @@ CuttingStatus Octree::diff_c(Octnode* current, const Volume* vol) {
     return status;
 }
 
-#ifdef POOL_NODE
-extern std::vector<Octnode*> nodePool;
-#endif
+// count the corners diff_cd() would have cut at max_depth, and material of parts
+CuttingStatus Octree::removed_status(Octnode* current) const {
+	CuttingStatus status = { 0, NO_COLLISION }, childstatus;
+	if ( current->is_outside() )
+		return status;
+	if ( current->childcount == 8 ) {
+		for(int m=0;m<8;++m) {
+			childstatus = removed_status( &current->child[m] );
+			status.cutcount += childstatus.cutcount;
+			status.collision |= childstatus.collision;
+		}
+	} else {
+		status.cutcount = 8 << ( 3*(this->max_depth-1-current->depth) );
+		if ( current->color.isGray() )
+			status.collision |= PARTS_COLLISION;
+	}
+	return status;
+}
 
 // string repr
 std::string Octree::str() const {
@@ -251,16 +522,12 @@ std::string Octree::str() const {
     std::vector<int> nodelevel(this->max_depth);
     std::vector<int> invalidsAtLevel(this->max_depth);
     std::vector<int> surfaceAtLevel(this->max_depth);
-    int totalVertexSize = 0;
     BOOST_FOREACH( Octnode* n, nodelist) {
         ++nodelevel[n->depth];
         if ( !n->valid() ) 
             ++invalidsAtLevel[n->depth];
         if (n->is_undecided() ) 
             ++surfaceAtLevel[n->depth];
-        for (int i = 0; i < 8; i++)
-        	 if (n->vertex[i] != 0)
-        		 totalVertexSize += sizeof(GLVertex);
     }
     o << "  " << nodelist.size() << " leaf-nodes:\n";
     int m=0;
@@ -274,9 +541,8 @@ std::string Octree::str() const {
     extern unsigned int delete_childlen_count;
     o << "    alocation count: " << alocation_count << "  delete count: " << delete_count << "  difference: " << alocation_count - delete_count << "\n";
     o << "    delete child count: " << delete_childlen_count << "\n";
-    o << "  total " << totalVertexSize << " bytes comsumed for vertex(" << sizeof(GLVertex) << " bytes). \n";
 #ifdef POOL_NODE
-    o << "  Node Pool size " << nodePool.size() << "\n";
+    o << "  Node Pool " << pool.slabCount() << " slabs, " << pool.usedBlocks() << " of " << pool.capacity() << " blocks used\n";
 #endif
     return o.str();
 }
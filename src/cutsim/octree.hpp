@@ -34,6 +34,7 @@ namespace cutsim {
 
 class Octnode;
 class Volume;
+class CsgVolume;
 
 /// Octree class for cutting simulation
 /// see http://en.wikipedia.org/wiki/Octree
@@ -50,19 +51,30 @@ class Octree {
 
     public:
         /// create an octree with a root node with scale=root_scale, maximum
-        /// tree-depth of max_depth and centered at centerp.
+        /// tree-depth of max_depth and centered at centerp. centerp is copied.
         Octree(double root_scale, unsigned int max_depth, GLVertex* centerPoint, GLData* gl);
         virtual ~Octree();
         
     // bolean operations on tree
         /// sum given Volume to tree
-        void sum(const Volume* vol) { sum( this->root, vol); }
+        void sum(const Volume* vol);
         /// diff given Volume from tree
-        void diff(const Volume* vol) { diff( this->root, vol); }
+        void diff(const Volume* vol);
         /// intersect tree with given Volume
-        void intersect(const Volume* vol) { intersect( this->root, vol); }
+        void intersect(const Volume* vol);
+        /// sum, diff or intersect each term of csg in one traversal, with the same surface as
+        /// calling sum(), diff() or intersect() for each term in turn
+        void apply(const CsgVolume* csg);
         /// diff given Volume from tree for cuttings
-        CuttingStatus diff_c(const Volume* vol) { return diff_c( this->root, vol); }
+        CuttingStatus diff_c(const Volume* vol);
+        /// diff_c() for a cutter of the type Cutter. The corner kernel of CylCutterVolume and
+        /// BallCutterVolume is inlined into the traversal instead of being called virtually.
+        template <class Cutter> CuttingStatus diff_cutter(const Volume* vol);
+        /// a diff_c() or diff_cutter() member
+        typedef CuttingStatus (Octree::*CutterDiff)(const Volume* vol);
+        /// return the diff_cutter() instance for the type of cutter, diff_c() if there is none.
+        /// Choose it once when the tool changes.
+        static CutterDiff cutterDiff(const CutterVolume* cutter);
         
 // debug, can be removed?
         /// put all leaf-nodes in a list
@@ -96,8 +108,14 @@ class Octree {
         unsigned int max_depth;
         /// pointer to the root node
         Octnode* root;
+        /// the lattice holding the centers and corners of all nodes
+        OctLattice lattice;
+        /// the allocator for the child blocks of all nodes
+        NodePool pool;
         /// the GLData used to draw this tree
         GLData* g;
+        /// the children of nodes above this depth are traversed by parallel tasks
+        unsigned int parallel_depth;
 
     protected:
         /// recursively traverse the tree subtracting Volume
@@ -106,8 +124,47 @@ class Octree {
         void sum(Octnode* current, const Volume* vol);
         /// intersect Octnode with Volume
         void intersect(Octnode* current, const Volume* vol);
-        // diff (intersection with volume's compliment) of tree and Volume for cuttings
-        CuttingStatus diff_c(Octnode* current, const Volume* vol);
+        // diff (intersection with volume's compliment) of tree and Volume for cuttings.
+        // collided tells that collides() was true above current.
+        template <class Cutter> CuttingStatus diff_c(Octnode* current, const Cutter* vol, bool collided);
+        /// apply the terms first+i of csg whose bit i is set in mask to current
+        void apply(Octnode* current, const CsgVolume* csg, unsigned int first, uint64_t mask);
+        /// call op on each child of current, by parallel tasks above parallel_depth, and merge their status
+        template <class Op> CuttingStatus visit_children(Octnode* current, const Op& op);
+        /// visit_children() operation calling sum(), diff() or intersect()
+        struct VolumeOp {
+            Octree* tree;
+            void (Octree::*op)(Octnode* current, const Volume* vol);
+            const Volume* vol;
+            CuttingStatus operator()(Octnode* child) const {
+                (tree->*op)(child, vol);
+                CuttingStatus none = { 0, NO_COLLISION };
+                return none;
+            }
+        };
+        /// visit_children() operation calling apply()
+        struct ApplyOp {
+            Octree* tree;
+            const CsgVolume* csg;
+            unsigned int first;
+            uint64_t mask;
+            CuttingStatus operator()(Octnode* child) const {
+                tree->apply(child, csg, first, mask);
+                CuttingStatus none = { 0, NO_COLLISION };
+                return none;
+            }
+        };
+        /// visit_children() operation calling diff_c()
+        template <class Cutter> struct DiffOp {
+            Octree* tree;
+            const Cutter* vol;
+            bool collided;
+            CuttingStatus operator()(Octnode* child) const { return tree->diff_c(child, vol, collided); }
+        };
+        /// the cutting status of removing all material below current
+        CuttingStatus removed_status(Octnode* current) const;
+        /// true if the neck, shank or holder of vol may collide with the material of current. The tree is not changed.
+        template <class Cutter> bool collides(const Octnode* current, const Cutter* vol) const;
 
     // DATA
         /// the GLData used to draw this tree
@@ -0,0 +1,204 @@
+/*
+ *  Copyright 2015      Kazuyasu Hamada (k-hamada@gifu-u.ac.jp)
+ *
+ *  This file is part of OpenCAMlib.
+ *
+ *  OpenCAMlib is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  OpenCAMlib is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with OpenCAMlib.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+#include <fstream>
+
+#include "sdf_grid.hpp"
+
+namespace cutsim {
+
+/// first bytes of a grid file, the last character is the format version
+static const char sdfMagic[8] = { 'C', 'S', 'I', 'M', 'S', 'D', 'F', '2' };
+
+SdfKey::SdfKey() : fileHash(0), step(0.0), band(0.0) {
+    for (int n = 0; n < 12; n++)
+        placement[n] = 0.0;
+}
+
+bool SdfKey::operator==(const SdfKey& k) const {
+    if (fileHash != k.fileHash || step != k.step || band != k.band)
+        return false;
+    for (int n = 0; n < 12; n++)
+        if (placement[n] != k.placement[n])
+            return false;
+    return true;
+}
+
+bool SdfKey::hashFile(const std::string& path) {
+    std::ifstream in(path.c_str(), std::ios::in | std::ios::binary);
+    if (!in)
+        return false;
+    uint64_t h = 14695981039346656037ULL;
+    char buf[64*1024];
+    while (in) {
+        in.read(buf, sizeof(buf));
+        std::streamsize n = in.gcount();
+        for (std::streamsize i = 0; i < n; i++) {
+            h ^= (unsigned char)buf[i];
+            h *= 1099511628211ULL;
+        }
+    }
+    fileHash = h;
+    return true;
+}
+
+void SdfGrid::clear() {
+    step = invStep = 0.0;
+    band = 0.0f;
+    bricks[0] = bricks[1] = bricks[2] = 0;
+    brickIndex.clear();
+    samples.clear();
+}
+
+void SdfGrid::build(const FacetTree& tree, const GLVertex& lo, const GLVertex& hi, const GLVertex& anchor, double s, double b) {
+    clear();
+    if (s <= 0.0 || tree.empty())
+        return;
+    double l[3] = { lo.x - b, lo.y - b, lo.z - b };
+    double h[3] = { hi.x + b, hi.y + b, hi.z + b };
+    double a[3] = { anchor.x, anchor.y, anchor.z };
+    for (int c = 0; c < 3; c++) {
+        origin[c] = a[c] + s * floor( (l[c] - a[c]) / s );
+        int cells = (int)ceil( (h[c] - origin[c]) / s );
+        bricks[c] = std::max( (cells + SDF_BRICK_CELLS - 1) / SDF_BRICK_CELLS, 1 );
+    }
+    int count = bricks[0] * bricks[1] * bricks[2];
+    brickIndex.resize(count);
+
+    // a brick is sampled if its center lies within band plus its half diagonal of the surface,
+    // elsewhere the distance field keeps its sign and exceeds band
+    const double reach = b + 0.5 * sqrt(3.0) * SDF_BRICK_CELLS * s;
+    #pragma omp parallel for schedule(dynamic)
+    for (int n = 0; n < count; n++) {
+        int i = n % bricks[0], j = (n / bricks[0]) % bricks[1], k = n / (bricks[0] * bricks[1]);
+        double half = 0.5 * SDF_BRICK_CELLS;
+        GLVertex c( origin[0] + (i * SDF_BRICK_CELLS + half) * s,
+                    origin[1] + (j * SDF_BRICK_CELLS + half) * s,
+                    origin[2] + (k * SDF_BRICK_CELLS + half) * s );
+        double d = tree.dist(c);
+        brickIndex[n] = (fabs(d) <= reach) ? 0 : ( (d < 0.0) ? OUTSIDE_BRICK : INSIDE_BRICK );
+    }
+    int sampled = 0;
+    for (int n = 0; n < count; n++)
+        if (brickIndex[n] >= 0)
+            brickIndex[n] = sampled++;
+
+    const int perBrick = SDF_BRICK_SAMPLES * SDF_BRICK_SAMPLES * SDF_BRICK_SAMPLES;
+    samples.resize( (size_t)sampled * perBrick );
+    #pragma omp parallel for schedule(dynamic)
+    for (int n = 0; n < count; n++) {
+        if (brickIndex[n] < 0)
+            continue;
+        int i = n % bricks[0], j = (n / bricks[0]) % bricks[1], k = n / (bricks[0] * bricks[1]);
+        float* p = &samples[ (size_t)brickIndex[n] * perBrick ];
+        for (int z = 0; z < SDF_BRICK_SAMPLES; z++)
+            for (int y = 0; y < SDF_BRICK_SAMPLES; y++)
+                for (int x = 0; x < SDF_BRICK_SAMPLES; x++) {
+                    GLVertex v( origin[0] + (i * SDF_BRICK_CELLS + x) * s,
+                                origin[1] + (j * SDF_BRICK_CELLS + y) * s,
+                                origin[2] + (k * SDF_BRICK_CELLS + z) * s );
+                    *p++ = (float)std::max( std::min( tree.dist(v), b ), -b );
+                }
+    }
+    band = (float)b;
+    step = s;
+    invStep = 1.0 / s;
+}
+
+bool SdfGrid::load(const std::string& path, const SdfKey& key) {
+    clear();
+    std::ifstream in(path.c_str(), std::ios::in | std::ios::binary);
+    if (!in)
+        return false;
+    char magic[8];
+    SdfKey stored;
+    double o[3], s;
+    int32_t nb[3], sampled;
+    float b;
+    in.read(magic, sizeof(magic));
+    in.read((char*)&stored.fileHash, sizeof(stored.fileHash));
+    in.read((char*)&stored.step, sizeof(stored.step));
+    in.read((char*)&stored.band, sizeof(stored.band));
+    in.read((char*)stored.placement, sizeof(stored.placement));
+    in.read((char*)o, sizeof(o));
+    in.read((char*)&s, sizeof(s));
+    in.read((char*)nb, sizeof(nb));
+    in.read((char*)&b, sizeof(b));
+    in.read((char*)&sampled, sizeof(sampled));
+    if ( !in || memcmp(magic, sdfMagic, sizeof(magic)) != 0 || !(stored == key) )
+        return false;
+    if ( s <= 0.0 || nb[0] <= 0 || nb[1] <= 0 || nb[2] <= 0 || sampled < 0 )
+        return false;
+
+    int count = nb[0] * nb[1] * nb[2];
+    const int perBrick = SDF_BRICK_SAMPLES * SDF_BRICK_SAMPLES * SDF_BRICK_SAMPLES;
+    brickIndex.resize(count);
+    samples.resize( (size_t)sampled * perBrick );
+    in.read((char*)&brickIndex[0], count * sizeof(int));
+    if (sampled)
+        in.read((char*)&samples[0], samples.size() * sizeof(float));
+    if (!in) {
+        clear();
+        return false;
+    }
+    for (int n = 0; n < count; n++) {
+        if ( brickIndex[n] >= sampled || brickIndex[n] < INSIDE_BRICK ) {
+            clear();
+            return false;
+        }
+    }
+    for (int c = 0; c < 3; c++) {
+        origin[c] = o[c];
+        bricks[c] = nb[c];
+    }
+    band = b;
+    step = s;
+    invStep = 1.0 / s;
+    return true;
+}
+
+bool SdfGrid::save(const std::string& path, const SdfKey& key) const {
+    if (!valid())
+        return false;
+    std::ofstream out(path.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+    if (!out)
+        return false;
+    int32_t nb[3] = { bricks[0], bricks[1], bricks[2] };
+    int32_t sampled = (int32_t)( samples.size() / (SDF_BRICK_SAMPLES * SDF_BRICK_SAMPLES * SDF_BRICK_SAMPLES) );
+    out.write(sdfMagic, sizeof(sdfMagic));
+    out.write((const char*)&key.fileHash, sizeof(key.fileHash));
+    out.write((const char*)&key.step, sizeof(key.step));
+    out.write((const char*)&key.band, sizeof(key.band));
+    out.write((const char*)key.placement, sizeof(key.placement));
+    out.write((const char*)origin, sizeof(origin));
+    out.write((const char*)&step, sizeof(step));
+    out.write((const char*)nb, sizeof(nb));
+    out.write((const char*)&band, sizeof(band));
+    out.write((const char*)&sampled, sizeof(sampled));
+    out.write((const char*)&brickIndex[0], brickIndex.size() * sizeof(int));
+    if (sampled)
+        out.write((const char*)&samples[0], samples.size() * sizeof(float));
+    return !out.fail();
+}
+
+} // end namespace
+// end file sdf_grid.cpp
@@ -0,0 +1,131 @@
+/*
+ *  Copyright 2015      Kazuyasu Hamada (k-hamada@gifu-u.ac.jp)
+ *
+ *  This file is part of OpenCAMlib.
+ *
+ *  OpenCAMlib is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  OpenCAMlib is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with OpenCAMlib.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef SDF_GRID_H
+#define SDF_GRID_H
+
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+#include "facet_tree.hpp"
+
+namespace cutsim {
+
+/// cells along each side of a brick of an SdfGrid
+#define SDF_BRICK_CELLS     8
+/// samples along each side of a brick, bricks share their boundary samples with their neighbours
+#define SDF_BRICK_SAMPLES   (SDF_BRICK_CELLS + 1)
+
+/// identifies the STL file and the placement an SdfGrid was sampled for
+struct SdfKey {
+    SdfKey();
+    /// FNV-1a hash of the contents of the STL file
+    uint64_t fileHash;
+    /// grid step
+    double step;
+    /// width of the sampled band around the surface
+    double band;
+    /// grid anchor, center, rotation center and angle of the volume
+    double placement[12];
+    /// true if both keys are the same
+    bool operator==(const SdfKey& k) const;
+    /// compute the hash of the file at path into fileHash. false if the file cannot be read.
+    bool hashFile(const std::string& path);
+};
+
+/// signed distance of a volume, sampled in a narrow band around its surface.
+///
+/// The samples lie on a lattice of spacing step through an anchor point. Choosing the
+/// octree leaf side-length as step and the octree center as anchor puts every node corner
+/// on a sample. The lattice is split into bricks of SDF_BRICK_CELLS^3 cells. Only the
+/// bricks within band of the surface store samples; the others store the sign only and
+/// return +-band, as do the points outside the grid.
+class SdfGrid {
+    public:
+        SdfGrid() : step(0.0), invStep(0.0), band(0.0f) { bricks[0] = bricks[1] = bricks[2] = 0; }
+        /// sample the signed distance of tree over the box [lo, hi] enlarged by band
+        void build(const FacetTree& tree, const GLVertex& lo, const GLVertex& hi, const GLVertex& anchor, double s, double b);
+        /// read the grid from the file at path. false if the file does not hold a grid for key.
+        bool load(const std::string& path, const SdfKey& key);
+        /// write the grid with key to the file at path. false on a write error.
+        bool save(const std::string& path, const SdfKey& key) const;
+        /// remove all samples
+        void clear();
+        /// true if the grid holds samples
+        bool valid() const { return step > 0.0; }
+        /// trilinear distance at p into d, -band outside the grid. false if the grid holds no samples.
+        inline bool dist(const GLVertex& p, double& d) const {
+            double g[3] = { (p.x - origin[0]) * invStep, (p.y - origin[1]) * invStep, (p.z - origin[2]) * invStep };
+            int i[3], b[3];
+            for (int c = 0; c < 3; c++) {
+                if ( !(g[c] >= 0.0) || g[c] >= bricks[c] * SDF_BRICK_CELLS ) {
+                    if (step == 0.0)
+                        return false;
+                    d = -band;  // the grid covers the volume and the band around it
+                    return true;
+                }
+                i[c] = (int)g[c];
+                g[c] -= i[c];
+                b[c] = i[c] / SDF_BRICK_CELLS;
+                i[c] -= b[c] * SDF_BRICK_CELLS;
+            }
+            int brick = brickIndex[ (b[2] * bricks[1] + b[1]) * bricks[0] + b[0] ];
+            if (brick < 0) {
+                d = (brick == OUTSIDE_BRICK) ? -band : band;
+                return true;
+            }
+            const float* s = &samples[ brick * SDF_BRICK_SAMPLES*SDF_BRICK_SAMPLES*SDF_BRICK_SAMPLES
+                                       + (i[2] * SDF_BRICK_SAMPLES + i[1]) * SDF_BRICK_SAMPLES + i[0] ];
+            const int dy = SDF_BRICK_SAMPLES, dz = SDF_BRICK_SAMPLES * SDF_BRICK_SAMPLES;
+            double x00 = s[0]       + (s[1]           - s[0])       * g[0];
+            double x10 = s[dy]      + (s[dy + 1]      - s[dy])      * g[0];
+            double x01 = s[dz]      + (s[dz + 1]      - s[dz])      * g[0];
+            double x11 = s[dz + dy] + (s[dz + dy + 1] - s[dz + dy]) * g[0];
+            double y0 = x00 + (x10 - x00) * g[1];
+            double y1 = x01 + (x11 - x01) * g[1];
+            d = y0 + (y1 - y0) * g[2];
+            return true;
+        }
+
+    protected:
+        /// brickIndex of a brick farther than band outside the surface
+        static const int OUTSIDE_BRICK = -1;
+        /// brickIndex of a brick farther than band inside the surface
+        static const int INSIDE_BRICK  = -2;
+        /// position of the first sample
+        double origin[3];
+        /// distance between samples
+        double step;
+        /// 1/step
+        double invStep;
+        /// number of bricks along x, y and z
+        int bricks[3];
+        /// the stored distances are clamped to +-band
+        float band;
+        /// for each brick, x fastest, its block in samples or OUTSIDE_BRICK or INSIDE_BRICK
+        std::vector<int> brickIndex;
+        /// SDF_BRICK_SAMPLES^3 distances per sampled brick, x fastest
+        std::vector<float> samples;
+};
+
+} // end namespace
+#endif
+// end file sdf_grid.hpp
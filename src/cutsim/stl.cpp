@@ -1,94 +1,257 @@
 #include <iostream>
 #include <list>
 #include <cassert>
+#include <cctype>
+#include <cmath>
+#include <cstring>
+#include <vector>
+#include <stdint.h>
 
 #include <QFile>
-#include <QTextStream>
 
 #include "stl.hpp"
 #include "glvertex.hpp"
-#include <app/lex_analyzer.hpp>
 
 namespace cutsim {
 
+/// bytes of the header and the facet count of a binary STL
+#define STL_BINARY_HEADER	84
+/// bytes of one facet of a binary STL: normal, three vertices and the attribute count
+#define STL_BINARY_FACET	50
+
 int Stl::readStlFile(QString file)
 {
 	int error_count = 0;
-	int line_count = 0;
 	QFile stlFileHandle( file );
-	QString line;
-	bool ascii_stl_start = false, facet_start = false, outer_loop_start = false;
-	GLVertex normal, vertex[3];
+
+	if ( !stlFileHandle.open( QIODevice::ReadOnly ) ) {
+		std::cout << "Can't open STL file:" << file.toStdString() << "\n";
+		return 1;
+	}
+
+	long long size = stlFileHandle.size();
+	const unsigned char* data = stlFileHandle.map(0, size);
+	std::vector<char> buffer;
+	if (data == NULL && size > 0) { // the file system does not support mapping
+		buffer.resize(size);
+		if (stlFileHandle.read(&buffer[0], size) != size) {
+			std::cout << "Can't read STL file:" << file.toStdString() << "\n";
+			stlFileHandle.close();
+			return 1;
+		}
+		data = (const unsigned char*)&buffer[0];
+	}
+
+	// a binary STL holds the facets given by its count. Trailing bytes after them are tolerated,
+	// some writers pad the file. Its header may start with "solid" as well, so a file which
+	// could be binary is only read as ASCII if that gives facets.
+	bool exact = false, fits = false;
+	if (size >= STL_BINARY_HEADER) {
+		uint32_t count;
+		memcpy(&count, data + 80, sizeof(count));
+		long long needed = STL_BINARY_HEADER + (long long)count * STL_BINARY_FACET;
+		exact = ( size == needed );
+		fits = ( size >= needed );
+	}
+	const char* p = (const char*)data;
+	const char* end = p + size;
+	while (p < end && isspace((unsigned char)*p))
+		p++;
+	size_t first = facets.size();
+	if (exact)
+		error_count = readBinary(data, size);
+	else if (end - p >= 5 && strncmp(p, "solid", 5) == 0) {
+		if (fits) {
+			// probe quietly, the ASCII errors of a binary file are noise
+			error_count = readAscii(p, end, true);
+			if (facets.size() == first)
+				error_count = readBinary(data, size);
+			else if (error_count > 0) {	// it is ASCII, read it again to report the errors
+				facets.resize(first);
+				error_count = readAscii(p, end);
+			}
+		} else
+			error_count = readAscii(p, end);
+	} else if (size >= STL_BINARY_HEADER)
+		error_count = readBinary(data, size);
+	else {
+		error_count++;
+		std::cout << "Not an STL file:" << file.toStdString() << "\n";
+	}
+
+	if (facets.empty() && error_count == 0) {
+		error_count++;
+		std::cout << "No facets in STL file:" << file.toStdString() << "\n";
+	}
+
+	if (buffer.empty())
+		stlFileHandle.unmap((unsigned char*)data);
+	stlFileHandle.close();
+
+std::cout << "Facet Count : " << facets.size() << "\n";
+	return error_count;
+}
+
+int Stl::readBinary(const unsigned char* data, long long size)
+{
+	int error_count = 0;
+	uint32_t count;
+	memcpy(&count, data + 80, sizeof(count));
+	long long available = (size - STL_BINARY_HEADER) / STL_BINARY_FACET;
+	if ((long long)count > available) {
+		error_count++;
+		std::cout << "binary STL truncated, " << available << " of " << count << " facets\n";
+		count = (uint32_t)available;
+	}
+
+	size_t first = facets.size();
+	facets.resize(first + count);
+	const unsigned char* f = data + STL_BINARY_HEADER;
+	for (uint32_t i = 0; i < count; i++, f += STL_BINARY_FACET) {
+		float v[12];	// little-endian, possibly unaligned
+		memcpy(v, f, sizeof(v));
+		Facet& facet = facets[first + i];
+		facet.normal = GLVertex(v[0], v[1], v[2]);
+		facet.v1 = GLVertex(v[3], v[4], v[5]);
+		facet.v2 = GLVertex(v[6], v[7], v[8]);
+		facet.v3 = GLVertex(v[9], v[10], v[11]);
+	}
+	return error_count;
+}
+
+/// skip white space, then return the word at p and move p past it
+static inline const char* nextWord(const char*& p, const char* end, size_t& length)
+{
+	while (p < end && isspace((unsigned char)*p))
+		p++;
+	const char* word = p;
+	while (p < end && !isspace((unsigned char)*p))
+		p++;
+	length = p - word;
+	return word;
+}
+
+/// true if the word of length equals keyword
+static inline bool isWord(const char* word, size_t length, const char* keyword)
+{
+	return strlen(keyword) == length && strncmp(word, keyword, length) == 0;
+}
+
+/// parse the number at p into v and move p past it. Returns false if there is no number.
+static bool parseNumber(const char*& p, const char* end, double& v)
+{
+	static const double power10[] = { 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+	                                   1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22 };
+	size_t length;
+	const char* s = nextWord(p, end, length);
+	const char* e = s + length;
+	bool negative = false;
+	if (s < e && (*s == '-' || *s == '+'))
+		negative = (*s++ == '-');
+	unsigned long long mantissa = 0;
+	int exponent = 0, digits = 0;
+	for (; s < e && isdigit((unsigned char)*s); s++, digits++) {
+		if (mantissa < 100000000000000000ULL)
+			mantissa = mantissa * 10 + (*s - '0');
+		else
+			exponent++;
+	}
+	if (s < e && *s == '.') {
+		for (s++; s < e && isdigit((unsigned char)*s); s++, digits++) {
+			if (mantissa < 100000000000000000ULL) {
+				mantissa = mantissa * 10 + (*s - '0');
+				exponent--;
+			}
+		}
+	}
+	if (digits == 0)
+		return false;
+	if (s < e && (*s == 'e' || *s == 'E')) {
+		s++;
+		bool negativeExponent = false;
+		if (s < e && (*s == '-' || *s == '+'))
+			negativeExponent = (*s++ == '-');
+		int x = 0;
+		if (s == e || !isdigit((unsigned char)*s))
+			return false;
+		for (; s < e && isdigit((unsigned char)*s); s++)
+			if (x < 10000)
+				x = x * 10 + (*s - '0');
+		exponent += negativeExponent ? -x : x;
+	}
+	if (s != e)
+		return false;
+	v = (double)mantissa;
+	if (exponent > 0)
+		v *= (exponent <= 22) ? power10[exponent] : pow(10.0, exponent);
+	else if (exponent < 0)
+		v /= (exponent >= -22) ? power10[-exponent] : pow(10.0, -exponent);
+	if (negative)
+		v = -v;
+	return true;
+}
+
+/// parse three numbers at p into a vertex. Returns false if one of them is missing.
+static inline bool parseVertex(const char*& p, const char* end, GLVertex& v)
+{
 	double x, y, z;
+	if (!parseNumber(p, end, x) || !parseNumber(p, end, y) || !parseNumber(p, end, z))
+		return false;
+	v = GLVertex(x, y, z);
+	return true;
+}
+
+int Stl::readAscii(const char* p, const char* end, bool quiet)
+{
+	int error_count = 0;
+	bool facet_start = false, outer_loop_start = false;
+	GLVertex normal, vertex[3];
 	int i = 0;
-	int facet_count = 0;
-
-	if ( stlFileHandle.open( QIODevice::ReadOnly | QIODevice::Text) ) {
-		QTextStream in( &stlFileHandle );
-		while ( !in.atEnd() ) {
-			line = in.readLine();         // line of text excluding '\n'
-			line_count++;
-			if (line.size() == 0) continue;
-			lex_analyzer::LexAnalyzer lex(line.toStdString());
-			if (lex.wordMatch("solid", 0) && lex.wordMatch("ascii", 1))
-				ascii_stl_start = true;
-			if (lex.wordMatch("endsolid", 0))
-				ascii_stl_start = false;
-			if (lex.wordMatch("facet", 0) && lex.wordMatch("normal", 1)) {
-				if (ascii_stl_start == true) {
-					facet_start = true;
-					x = lex.token2d(2); y = lex.token2d(3); z = lex.token2d(4);
-					if (x != NAN && y != NAN && z != NAN) {
-						normal = cutsim::GLVertex(x, y, z);
-std::cout << "normal x: " << x << " y: " << y << " z: " << z << "\n";
-					} else {
-						error_count++;
-						std::cout << "facet error2\n";
-					}
-				} else {
-					error_count++;
-					std::cout << "facet error1\n";
-				}
+	size_t length;
+
+	while (p < end) {
+		const char* word = nextWord(p, end, length);
+		if (length == 0)
+			break;
+		if (isWord(word, length, "facet")) {
+			word = nextWord(p, end, length);
+			if (isWord(word, length, "normal") && parseVertex(p, end, normal)) {
+				facet_start = true;
+			} else {
+				error_count++;
+				if (!quiet)
+					std::cout << "facet error\n";
 			}
-			if (lex.wordMatch("outer", 0) && lex.wordMatch("loop", 1))
-				if (facet_start == true) {
-					outer_loop_start = true;
-					i = 0;
-				}
-			if (lex.wordMatch("vertex", 0)) {
-				if (outer_loop_start == true) {
-					x = lex.token2d(1); y = lex.token2d(2); z = lex.token2d(3);
-					if (x != NAN && y != NAN && z != NAN && i < 3) {
-						vertex[i++] = cutsim::GLVertex(x, y, z);
-std::cout << "vertex x: " << x << " y: " << y << " z: " << z << "\n";
-					} else {
-						error_count++;
-						std::cout << "vertex error2\n";
-					}
-				} else {
-					error_count++;
-					std::cout << "vertex error1\n";
-				}
+		} else if (isWord(word, length, "outer")) {
+			word = nextWord(p, end, length);
+			if (facet_start && isWord(word, length, "loop")) {
+				outer_loop_start = true;
+				i = 0;
 			}
-			if (lex.wordMatch("endloop", 0))
-				outer_loop_start = false;
-			if (lex.wordMatch("endfacet", 0)) {
-				facet_start = false;
-				addFacet(new cutsim::Facet(normal, vertex[0], vertex[1], vertex[2]));
-				facet_count++;
+		} else if (isWord(word, length, "vertex")) {
+			if (outer_loop_start && i < 3 && parseVertex(p, end, vertex[i])) {
+				i++;
+			} else {
+				error_count++;
+				if (!quiet)
+					std::cout << "vertex error\n";
 			}
-			if (lex.wordMatch("endsolid", 0)) {
-				ascii_stl_start = false;
-std::cout << "Facet Count : " << facet_count << "\n";
+		} else if (isWord(word, length, "endloop")) {
+			outer_loop_start = false;
+		} else if (isWord(word, length, "endfacet")) {
+			if (facet_start && i == 3) {
+				addFacet(Facet(normal, vertex[0], vertex[1], vertex[2]));
+			} else {
+				error_count++;
+				if (!quiet)
+					std::cout << "facet error\n";
 			}
+			facet_start = false;
+		} else if (isWord(word, length, "solid")) {
+			while (p < end && *p != '\n' && *p != '\r')	// skip the name of the solid
+				p++;
 		}
-	} else {
-		error_count++;
-std::cout << "Can't open STL file:" << file.toStdString() << "\n";
 	}
-
-	stlFileHandle.close();
-
 	return error_count;
 }
 
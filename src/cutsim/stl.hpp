@@ -4,6 +4,9 @@
 #include <iostream>
 #include <list>
 #include <cassert>
+#include <vector>
+
+#include <QString>
 
 #include "facet.hpp"
 
@@ -13,12 +16,19 @@ class Stl {
 
   public:
     	Stl() {}
-    	virtual ~Stl() { facets.resize(0); }
-    	void addFacet(Facet *f)	{ facets.push_back(f); }
+    	virtual ~Stl() {}
+    	void addFacet(const Facet& f)	{ facets.push_back(f); }
 
+    	/// read a binary or ASCII STL file. Returns the number of errors.
     	int readStlFile(QString file);
 
-    	std::vector<Facet*> facets;
+    	std::vector<Facet> facets;
+
+  protected:
+    	/// read the facets of a binary STL of size bytes at data
+    	int readBinary(const unsigned char* data, long long size);
+    	/// read the facets of an ASCII STL in [p, end). quiet suppresses the error messages.
+    	int readAscii(const char* p, const char* end, bool quiet = false);
 
   private:
 };
@@ -21,11 +21,46 @@
 
 #include <cassert>
 #include <cmath>
+#include <algorithm>
+#include <limits>
+#include <vector>
 
 #include "volume.hpp"
+#include "cutter_kernel.hpp"
 
 namespace cutsim {
 
+void Volume::dist8(const Corners& p, double d[8]) const {
+    for (int n = 0; n < 8; ++n)
+        d[n] = dist( GLVertex(p.x[n], p.y[n], p.z[n]) );
+}
+
+// store the lanes of f to d
+static inline void storeCorners(const Float8& f, double d[8]) {
+    float lanes[8];
+    f.store(lanes);
+    for (int n = 0; n < 8; ++n)
+        d[n] = lanes[n];
+}
+
+void Volume::distBounds(const GLVertex& minpt, const GLVertex& maxpt, double& lower, double& upper) const {
+    GLVertex center = (minpt + maxpt) * 0.5;
+    double r = (maxpt - minpt).norm() * 0.5;
+    double d = dist(center);
+    lower = d - r;
+    upper = d + r;
+}
+
+// signed distance from p to the box [minpt, maxpt], positive inside
+static double boxDist(const GLVertex& minpt, const GLVertex& maxpt, const GLVertex& p) {
+    double q[3] = { fmax(minpt.x - p.x, p.x - maxpt.x), fmax(minpt.y - p.y, p.y - maxpt.y), fmax(minpt.z - p.z, p.z - maxpt.z) };
+    double out = 0.0;
+    for (int n = 0; n < 3; ++n)
+        if (q[n] > 0.0)
+            out += q[n] * q[n];
+    return -( sqrt(out) + fmin( fmax( fmax(q[0], q[1]), q[2] ), 0.0 ) );
+}
+
 //************* Sphere **************/
 
 /// sphere at center
@@ -40,6 +75,13 @@ double SphereVolume::dist(const GLVertex& p ) const {
     return radius-d; // positive inside. negative outside.
 }
 
+void SphereVolume::dist8(const Corners& p, double d[8]) const {
+    Float8 x = Float8(center.x) - Float8::load(p.x);
+    Float8 y = Float8(center.y) - Float8::load(p.y);
+    Float8 z = Float8(center.z) - Float8::load(p.z);
+    storeCorners( Float8(radius) - sqrt(x*x + y*y + z*z), d );
+}
+
 /// set the bounding box values
 void SphereVolume::calcBB() {
     bb.clear();
@@ -49,6 +91,21 @@ void SphereVolume::calcBB() {
     bb.addPoint( minpt );
 }
 
+void SphereVolume::distBounds(const GLVertex& minpt, const GLVertex& maxpt, double& lower, double& upper) const {
+    double c[3] = { center.x, center.y, center.z };
+    double lo[3] = { minpt.x, minpt.y, minpt.z };
+    double hi[3] = { maxpt.x, maxpt.y, maxpt.z };
+    double nearest = 0.0, farthest = 0.0;
+    for (int n = 0; n < 3; ++n) {
+        double a = fmax( fmax(lo[n] - c[n], c[n] - hi[n]), 0.0 );
+        double b = fmax( c[n] - lo[n], hi[n] - c[n] );
+        nearest += a * a;
+        farthest += b * b;
+    }
+    lower = radius - sqrt(farthest);
+    upper = radius - sqrt(nearest);
+}
+
 //************* Rectangle **************/
 
 RectVolume::RectVolume() {
@@ -161,6 +218,13 @@ double RectVolume::dist(const GLVertex& p) const {
     return -dOut;
 }
     
+void RectVolume::distBounds(const GLVertex& minpt, const GLVertex& maxpt, double& lower, double& upper) const {
+    double r = (maxpt - minpt).norm() * 0.5;
+    double d = boxDist( corner, corner + GLVertex(v1.x, v2.y, v3.z), (minpt + maxpt) * 0.5 );
+    lower = d - r;
+    upper = d + r;
+}
+
 RectVolume2::RectVolume2() {
     corner = GLVertex(0,0,0);
     width = 1.0;
@@ -169,6 +233,12 @@ RectVolume2::RectVolume2() {
     center = GLVertex(corner.x+width*0.5, corner.y+length*0.5, corner.z+hight*0.5);	// center is located at the center of box
     rotationCenter = GLVertex(0, 0, 0);
     angle = GLVertex(0, 0, 0);
+    calcRotation();
+}
+
+void RectVolume2::calcRotation() {
+    GLVertex::rotationAC(angle.x, angle.z, rotation);
+    shift = rotationCenter - rotationCenter.rotateAC(rotation);
 }
 
 void RectVolume2::calcBB() {
@@ -200,8 +270,7 @@ void RectVolume2::calcBB() {
 }
 
 double RectVolume2::dist(const GLVertex& p) const {
-    GLVertex rotated_p = p - rotationCenter;
-    rotated_p = rotated_p.rotateAC(angle.x, angle.z) + rotationCenter;
+    GLVertex rotated_p = p.rotateAC(rotation) + shift;
     double max_x = corner.x + width;
     double min_x = corner.x;
     double max_y = corner.y + length;
@@ -283,6 +352,62 @@ double RectVolume2::dist(const GLVertex& p) const {
     return -dOut;
 }
 
+// the distance of the corner regions, as in dist()
+static inline Float8 edgeDist(const Float8& a, const Float8& b) {
+    return sqrt(a*a + b*b);
+}
+
+// dist() at the eight corners. The cases of dist() are evaluated in all lanes and the first
+// one which holds in a lane is selected, so the cases are applied from the last to the first.
+void RectVolume2::dist8(const Corners& p, double d[8]) const {
+    Float8 x, y, z;
+    rotateCorners(p, rotation, shift, GLVertex(0.0, 0.0, 0.0), x, y, z);
+    Float8 max_x(corner.x + width),  min_x(corner.x);
+    Float8 max_y(corner.y + length), min_y(corner.y);
+    Float8 max_z(corner.z + hight),  min_z(corner.z);
+    Float8 zero(0.0f);
+    Mask8 in_x = (min_x <= x) & (x <= max_x);
+    Mask8 in_y = (min_y <= y) & (y <= max_y);
+    Mask8 in_z = (min_z <= z) & (z <= max_z);
+    Mask8 over_x = x > max_x, under_x = x < min_x;
+    Mask8 over_y = y > max_y, under_y = y < min_y;
+    Mask8 over_z = z > max_z, under_z = z < min_z;
+
+    Float8 dOut = zero;
+    dOut = select(under_y & under_z, edgeDist(min_y - y, min_z - z), dOut);
+    dOut = select(under_x & over_z,  edgeDist(min_x - x, z - max_z), dOut);
+    dOut = select(over_y  & under_z, edgeDist(y - max_y, min_y - y), dOut);
+    dOut = select(under_x & under_z, edgeDist(x - max_x, min_z - z), dOut);
+    dOut = select(under_y & over_z,  edgeDist(min_y - y, z - max_z), dOut);
+    dOut = select(under_x & under_y, edgeDist(min_x - x, y - max_y), dOut);
+    dOut = select(over_x  & under_y, edgeDist(x - max_x, min_y - y), dOut);
+    dOut = select(over_x  & over_z,  edgeDist(x - max_x, z - max_z), dOut);
+    dOut = select(over_y  & over_z,  edgeDist(y - max_y, z - max_z), dOut);
+    dOut = select(under_x & over_y,  edgeDist(min_x - x, y - max_y), dOut);
+    dOut = select(over_x  & under_z, edgeDist(x - max_x, min_z - z), dOut);
+    dOut = select(over_x  & over_y,  edgeDist(x - max_x, y - max_y), dOut);
+    dOut = select(in_x & in_y, select(under_z, min_z - z, select(over_z, z - max_z, zero)), dOut);
+    dOut = select(in_x & in_z, select(under_y, min_y - y, select(over_y, y - max_y, zero)), dOut);
+    dOut = select(in_y & in_z, select(under_x, min_x - x, select(over_x, x - max_x, zero)), dOut);
+    // inside, the negated distance to the nearest face
+    Float8 xdist = min(x - min_x, max_x - x);
+    Float8 ydist = min(y - min_y, max_y - y);
+    Float8 zdist = min(z - min_z, max_z - z);
+    Float8 inside = select((xdist <= ydist) & (xdist <= zdist), xdist, select((ydist < xdist) & (ydist < zdist), ydist, zdist));
+    dOut = select(in_x & in_y & in_z, -inside, dOut);
+    storeCorners( -dOut, d );
+}
+
+// dist() does not return the distance in all the corner regions, bound the exact distance of the box
+// instead. It has the same sign.
+void RectVolume2::distBounds(const GLVertex& minpt, const GLVertex& maxpt, double& lower, double& upper) const {
+    double r = (maxpt - minpt).norm() * 0.5;
+    GLVertex rotated_p = ((minpt + maxpt) * 0.5).rotateAC(rotation) + shift;
+    double d = boxDist( corner, corner + GLVertex(width, length, hight), rotated_p );
+    lower = d - r;
+    upper = d + r;
+}
+
 //************* Cylinder **************/
 
 CylinderVolume::CylinderVolume() {
@@ -291,6 +416,12 @@ CylinderVolume::CylinderVolume() {
     center = GLVertex(0, 0, 0);	// center is located at the bottom of cylinder
     rotationCenter = GLVertex(0, 0, 0);
     angle  = GLVertex(0, 0, 0);
+    calcRotation();
+}
+
+void CylinderVolume::calcRotation() {
+    GLVertex::rotationAC(angle.x, angle.z, rotation);
+    shift = rotationCenter - rotationCenter.rotateAC(rotation);
 }
 
 void CylinderVolume::calcBB() {
@@ -322,8 +453,7 @@ void CylinderVolume::calcBB() {
 }
 
 double CylinderVolume::dist(const GLVertex& p) const {
-    GLVertex rotated_p = p - rotationCenter;
-    rotated_p = rotated_p.rotateAC(angle.x, angle.z) + rotationCenter;
+    GLVertex rotated_p = p.rotateAC(rotation) + shift;
     GLVertex tb = rotated_p - center;
     GLVertex tt = rotated_p - (center + GLVertex(0.0, 0.0, length));
     double d = (rotated_p - GLVertex(center.x, center.y, rotated_p.z)).norm();
@@ -353,6 +483,66 @@ double CylinderVolume::dist(const GLVertex& p) const {
    }
 }
 
+// dist() is -(min(max(a,b),0) + |(max(a,0),max(b,0))|) for the radial excess a = d-radius and the axial
+// excess b beyond the nearer end, falling in both. Bound a and b over the box around the corners of the
+// box turned into the frame of the cylinder.
+void CylinderVolume::distBounds(const GLVertex& minpt, const GLVertex& maxpt, double& lower, double& upper) const {
+    GLVertex t = minpt.rotateAC(rotation) + shift - center;
+    double lo[3] = { t.x, t.y, t.z }, hi[3] = { t.x, t.y, t.z };
+    for (int n=1;n<8;++n) {
+        GLVertex p = GLVertex( (n & 1) ? maxpt.x : minpt.x, (n & 2) ? maxpt.y : minpt.y, (n & 4) ? maxpt.z : minpt.z );
+        t = p.rotateAC(rotation) + shift - center;
+        double c[3] = { t.x, t.y, t.z };
+        for (int m=0;m<3;++m) {
+            lo[m] = fmin(lo[m], c[m]);
+            hi[m] = fmax(hi[m], c[m]);
+        }
+    }
+    // distance from the axis
+    double nearest = 0.0, farthest = 0.0;
+    for (int m=0;m<2;++m) {
+        double dn = fmax( fmax(lo[m], -hi[m]), 0.0 );
+        double df = fmax( -lo[m], hi[m] );
+        nearest += dn * dn;
+        farthest += df * df;
+    }
+    double amin = sqrt(nearest) - radius, amax = sqrt(farthest) - radius;
+    // distance from the middle of the length
+    double half = length * 0.5;
+    double zn = (lo[2] <= half && half <= hi[2]) ? 0.0 : fmin( fabs(lo[2] - half), fabs(hi[2] - half) );
+    double zf = fmax( fabs(lo[2] - half), fabs(hi[2] - half) );
+    double bmin = zn - half, bmax = zf - half;
+    // the rotation is in float, allow for its rounding
+    lower = -( fmin(fmax(amax, bmax), 0.0) + hypot( fmax(amax, 0.0), fmax(bmax, 0.0) ) ) - TOLERANCE;
+    upper = -( fmin(fmax(amin, bmin), 0.0) + hypot( fmax(amin, 0.0), fmax(bmin, 0.0) ) ) + TOLERANCE;
+    if (angle.x != 0.0 || angle.z != 0.0) { // the turned box may be looser than the ball around it
+        double l, u;
+        Volume::distBounds(minpt, maxpt, l, u);
+        lower = fmax(lower, l);
+        upper = fmin(upper, u);
+    }
+}
+
+void CylinderVolume::dist8(const Corners& p, double d[8]) const {
+    Float8 x, y, tbz;
+    rotateCorners(p, rotation, shift, center, x, y, tbz);
+    Float8 ttz = tbz - Float8(length);
+    Float8 r(radius);
+    Float8 dxy = sqrt(x*x + y*y);
+    Float8 side = r - dxy;
+    // between the bottom and the top, the nearest of the side, the bottom and the top
+    Float8 within = select((side < tbz) & (side < -ttz), side, min(tbz, -ttz));
+    // under or above, the flat end or the distance to the outer ring of that end
+    Mask8 under = tbz < Float8(0.0f);
+    Float8 ez = select(under, tbz, ttz);
+    Float8 scale = r / dxy;
+    Float8 rx = x - x * scale;
+    Float8 ry = y - y * scale;
+    Float8 ring = -sqrt(rx*rx + ry*ry + ez*ez);
+    Float8 end = select(dxy < r, select(under, tbz, -ttz), ring);
+    storeCorners( select(~under & (ttz <= Float8(0.0f)), within, end), d );
+}
+
 //************* STL **************/
 
 StlVolume::StlVolume() {
@@ -364,37 +554,33 @@ StlVolume::StlVolume() {
 void StlVolume::calcBB() {
     GLVertex maxpt;
     GLVertex minpt;
+    GLfloat M[3][3];
+    GLVertex::rotationAC(angle.x, angle.z, M);
     for (int i=0; i < (int)facets.size(); i++) {
-    	facets[i]->v1 += center; facets[i]->v2 += center; facets[i]->v3 += center;
-    	facets[i]->normal = facets[i]->normal.rotateAC(angle.x, angle.z);
-    	GLVertex v1p = facets[i]->v1 - rotationCenter;
-    	facets[i]->v1 = v1p.rotateAC(angle.x, angle.z) + rotationCenter;
-    	GLVertex v2p = facets[i]->v2 - rotationCenter;
-    	facets[i]->v2 = v2p.rotateAC(angle.x, angle.z) + rotationCenter;
-    	GLVertex v3p = facets[i]->v3 - rotationCenter;
-    	facets[i]->v3 = v3p.rotateAC(angle.x, angle.z) + rotationCenter;
+    	facets[i].v1 += center; facets[i].v2 += center; facets[i].v3 += center;
+    	facets[i].normal = facets[i].normal.rotateAC(M);
+    	GLVertex v1p = facets[i].v1 - rotationCenter;
+    	facets[i].v1 = v1p.rotateAC(M) + rotationCenter;
+    	GLVertex v2p = facets[i].v2 - rotationCenter;
+    	facets[i].v2 = v2p.rotateAC(M) + rotationCenter;
+    	GLVertex v3p = facets[i].v3 - rotationCenter;
+    	facets[i].v3 = v3p.rotateAC(M) + rotationCenter;
     }
     if (facets.size()) {
-        maxpt.x = fmax(fmax(facets[0]->v1.x, facets[0]->v2.x),facets[0]->v3.x);
-        maxpt.y = fmax(fmax(facets[0]->v1.y, facets[0]->v2.y),facets[0]->v3.y);
-        maxpt.z = fmax(fmax(facets[0]->v1.z, facets[0]->v2.z),facets[0]->v3.z);
-        minpt.x = fmin(fmin(facets[0]->v1.x, facets[0]->v2.x),facets[0]->v3.x);
-        minpt.y = fmin(fmin(facets[0]->v1.y, facets[0]->v2.y),facets[0]->v3.y);
-        minpt.z = fmin(fmin(facets[0]->v1.z, facets[0]->v2.z),facets[0]->v3.z);
+        maxpt.x = fmax(fmax(facets[0].v1.x, facets[0].v2.x),facets[0].v3.x);
+        maxpt.y = fmax(fmax(facets[0].v1.y, facets[0].v2.y),facets[0].v3.y);
+        maxpt.z = fmax(fmax(facets[0].v1.z, facets[0].v2.z),facets[0].v3.z);
+        minpt.x = fmin(fmin(facets[0].v1.x, facets[0].v2.x),facets[0].v3.x);
+        minpt.y = fmin(fmin(facets[0].v1.y, facets[0].v2.y),facets[0].v3.y);
+        minpt.z = fmin(fmin(facets[0].v1.z, facets[0].v2.z),facets[0].v3.z);
     }
     for (int i=0; i < (int)facets.size(); i++) {
-        maxpt.x = fmax(fmax(fmax(facets[i]->v1.x, facets[i]->v2.x),facets[i]->v3.x), maxpt.x);
-        maxpt.y = fmax(fmax(fmax(facets[i]->v1.y, facets[i]->v2.y),facets[i]->v3.y), maxpt.y);
-        maxpt.z = fmax(fmax(fmax(facets[i]->v1.z, facets[i]->v2.z),facets[i]->v3.z), maxpt.z);
-        minpt.x = fmin(fmin(fmin(facets[i]->v1.x, facets[i]->v2.x),facets[i]->v3.x), minpt.x);
-        minpt.y = fmin(fmin(fmin(facets[i]->v1.y, facets[i]->v2.y),facets[i]->v3.y), minpt.y);
-        minpt.z = fmin(fmin(fmin(facets[i]->v1.z, facets[i]->v2.z),facets[i]->v3.z), minpt.z);
-        V21.push_back(facets[i]->v2 - facets[i]->v1);
-        invV21dotV21.push_back(1.0/(facets[i]->v2 - facets[i]->v1).dot(facets[i]->v2 - facets[i]->v1));
-        V32.push_back(facets[i]->v3 - facets[i]->v2);
-        invV32dotV32.push_back(1.0/(facets[i]->v3 - facets[i]->v2).dot(facets[i]->v3 - facets[i]->v2));
-        V13.push_back(facets[i]->v1 - facets[i]->v3);
-        invV13dotV13.push_back(1.0/(facets[i]->v1 - facets[i]->v3).dot(facets[i]->v1 - facets[i]->v3));
+        maxpt.x = fmax(fmax(fmax(facets[i].v1.x, facets[i].v2.x),facets[i].v3.x), maxpt.x);
+        maxpt.y = fmax(fmax(fmax(facets[i].v1.y, facets[i].v2.y),facets[i].v3.y), maxpt.y);
+        maxpt.z = fmax(fmax(fmax(facets[i].v1.z, facets[i].v2.z),facets[i].v3.z), maxpt.z);
+        minpt.x = fmin(fmin(fmin(facets[i].v1.x, facets[i].v2.x),facets[i].v3.x), minpt.x);
+        minpt.y = fmin(fmin(fmin(facets[i].v1.y, facets[i].v2.y),facets[i].v3.y), minpt.y);
+        minpt.z = fmin(fmin(fmin(facets[i].v1.z, facets[i].v2.z),facets[i].v3.z), minpt.z);
     }
     bb.clear();
     maxpt += GLVertex(TOLERANCE, TOLERANCE, TOLERANCE);
@@ -403,101 +589,131 @@ std::cout << "STL maxpt x:" << maxpt.x << " y: " << maxpt.y << " z:" << maxpt.z
 std::cout << "STL minpt x:" << minpt.x << " y: " << minpt.y << " z:" << minpt.z  << "\n";
     bb.addPoint( maxpt );
     bb.addPoint( minpt );
+    tree.build(facets);
+    grid.clear();
+}
+
+bool StlVolume::useSdfGrid(const GLVertex& anchor, double step) {
+    SdfKey key;
+    key.step = step;
+    key.band = STL_SDF_BAND * step;
+    const GLVertex* placement[4] = { &anchor, &center, &rotationCenter, &angle };
+    for (int n = 0; n < 4; n++) {
+        key.placement[3*n]   = placement[n]->x;
+        key.placement[3*n+1] = placement[n]->y;
+        key.placement[3*n+2] = placement[n]->z;
+    }
+    std::string cache = fileName + ".sdf";
+    if ( key.hashFile(fileName) && grid.load(cache, key) )
+        return true;
+    grid.build(tree, bb.minpt, bb.maxpt, anchor, step, key.band);
+    if ( key.fileHash && !grid.save(cache, key) )
+        std::cout << "Can't write SDF cache file:" << cache << "\n";
+    return false;
 }
 
 double StlVolume::dist(const GLVertex& p) const {
-	GLVertex q, r;
-	GLVertex n1, n2, n3;
-	double s12, s23, s31;
-	double min = 1.0e+3, d, ret = -1.0, u, abs_d;
-	for (int i=0; i < (int)facets.size(); i++) {
-		u = (p - facets[i]->v1).dot(V21[i]) * invV21dotV21[i];
-		q = facets[i]->v1 + V21[i] * u;
-		d = (q - p).dot(facets[i]->normal);
-		if ((abs_d = fabs(d)) > min) continue;
-		r = p + facets[i]->normal * d;
-		n1 = (r - facets[i]->v1).cross(V13[i]);
-		n2 = (r - facets[i]->v2).cross(V21[i]);
-		n3 = (r - facets[i]->v3).cross(V32[i]);
-		s12 = n1.dot(n2); s23 = n2.dot(n3); s31 = n3.dot(n1);
-
-		if ((s12 * s31 > 0.0) && (s12 * s23 > 0.0) && (s23 * s31 > 0.0))
-			if (abs_d < min) {
-				min = abs_d;
-				ret = d;
-				continue;
-			}
-
-		if (s12 <= 0.0 && s31 >= 0.0) {
-			if (u > 0.0 && u < 1.0)
-				/*q21 = q*/;
-			else if (u <= 0.0)
-				q = facets[i]->v1;
-			else
-				q = facets[i]->v2;
-			abs_d = (q - p).norm();
-			if (abs_d < min) {
-				d = (q - p).dot(facets[i]->normal);
-				if (d > 0.0 + TOLERANCE) {
-					min = abs_d + TOLERANCE;
-					ret = abs_d;
-				} else {
-					min = abs_d;
-					ret = -abs_d;
-				}
-			}
-		} else if (s31 <= 0.0 && s23 >= 0.0) {
-			u = (p - facets[i]->v3).dot(V13[i]) * invV13dotV13[i];
-			if (u > 0.0 && u < 1.0)
-				q = facets[i]->v3 + V13[i] * u;
-			else if (u <= 0.0)
-				q = facets[i]->v3;
-			else
-				q = facets[i]->v1;
-			abs_d = (q - p).norm();
-			if (abs_d < min) {
-				d = (q - p).dot(facets[i]->normal);
-				if (d > 0.0 + TOLERANCE) {
-					min = abs_d + TOLERANCE;
-					ret = abs_d;
-				} else {
-					min = abs_d;
-					ret = -abs_d;
-				}
-			}
-		} else if (s23 <= 0.0 && s12 >= 0.0) {
-			u = (p - facets[i]->v2).dot(V32[i]) * invV32dotV32[i];
-			if (u > 0.0 && u < 1.0)
-				q = facets[i]->v2 + V32[i] * u;
-			else if (u <= 0.0)
-				q = facets[i]->v2;
-			else
-				q = facets[i]->v3;
-			abs_d = (q - p).norm();
-			if (abs_d < min) {
-				d = (q - p).dot(facets[i]->normal);
-				if (d > 0.0 + TOLERANCE) {
-					min = abs_d + TOLERANCE;
-					ret = abs_d;
-				} else {
-					min = abs_d;
-					ret = -abs_d;
-				}
-			}
-		}
-	}
-	return ret;		// positive inside. negative outside.
+    double d;
+    if ( grid.dist(p, d) )
+        return d;
+    return tree.dist(p);    // positive inside. negative outside.
+}
+
+void StlVolume::distBounds(const GLVertex& minpt, const GLVertex& maxpt, double& lower, double& upper) const {
+    GLVertex center = (minpt + maxpt) * 0.5;
+    double r = (maxpt - minpt).norm() * 0.5;
+    double d;
+    if ( grid.dist(center, d) )
+        r *= sqrt(3.0); // the trilinear samples change by at most the step along each axis
+    else
+        d = tree.dist(center);
+    lower = d - r;
+    upper = d + r;
+}
+
+
+//************* CSG **************/
+
+CsgVolume::~CsgVolume() {
+    for (unsigned int i = 0; i < terms.size(); i++)
+        delete terms[i].vol;
+}
+
+void CsgVolume::add(CsgOperation op, Volume* vol) {
+    Term t = { op, vol };
+    terms.push_back(t);
+    switch (op) {
+    case CSG_SUM:
+        if (empty) {
+            bb = vol->bb;
+            empty = false;
+        } else {
+            bb.addPoint( vol->bb.minpt );
+            bb.addPoint( vol->bb.maxpt );
+        }
+        break;
+    case CSG_DIFF:  // the box of the sum stays a bound
+        break;
+    case CSG_INTERSECT: {
+        if (empty)
+            break;
+        GLVertex minpt( fmax(bb.minpt.x, vol->bb.minpt.x), fmax(bb.minpt.y, vol->bb.minpt.y), fmax(bb.minpt.z, vol->bb.minpt.z) );
+        GLVertex maxpt( fmin(bb.maxpt.x, vol->bb.maxpt.x), fmin(bb.maxpt.y, vol->bb.maxpt.y), fmin(bb.maxpt.z, vol->bb.maxpt.z) );
+        if (minpt.x > maxpt.x || minpt.y > maxpt.y || minpt.z > maxpt.z) {
+            empty = true;
+            break;
+        }
+        bb.clear();
+        bb.addPoint( minpt );
+        bb.addPoint( maxpt );
+        break;
+    }
+    }
+    if (empty) {    // dist() is very negative everywhere, any box will do
+        bb.clear();
+        bb.addPoint( GLVertex(0.0, 0.0, 0.0) );
+    }
+}
+
+double CsgVolume::dist(const GLVertex& p) const {
+    double d = -std::numeric_limits<double>::max();
+    for (unsigned int i = 0; i < terms.size(); i++) {
+        double v = terms[i].vol->dist(p);
+        switch (terms[i].op) {
+        case CSG_SUM:       d = fmax(d,  v); break;
+        case CSG_DIFF:      d = fmin(d, -v); break;
+        case CSG_INTERSECT: d = fmin(d,  v); break;
+        }
+    }
+    return d;   // positive inside. negative outside.
+}
+
+void CsgVolume::distBounds(const GLVertex& minpt, const GLVertex& maxpt, double& lower, double& upper) const {
+    lower = upper = -std::numeric_limits<double>::max();
+    for (unsigned int i = 0; i < terms.size(); i++) {
+        double l, u;
+        terms[i].vol->distBounds(minpt, maxpt, l, u);
+        switch (terms[i].op) {
+        case CSG_SUM:       lower = fmax(lower,  l); upper = fmax(upper,  u); break;
+        case CSG_DIFF:      lower = fmin(lower, -u); upper = fmin(upper, -l); break;
+        case CSG_INTERSECT: lower = fmin(lower,  l); upper = fmin(upper,  u); break;
+        }
+    }
 }
 
 
 //************* CutterVolume **************/
 
 CutterVolume::CutterVolume() {
+    cuttertype = NO_TOOL;
     radius = 0.0;
     length = 0.0;
+    flutelength = reachlength = 0.0;
+    neckradius = shankradius = maxradius = 0.0;
     enableholder = false;
     holderradius = 0.0;
     holderlength = 0.0;
+    GLVertex::rotationAC(angle.x, angle.z, rotation);
 }
 
 void CutterVolume::calcBBHolder() {
@@ -508,9 +724,78 @@ void CutterVolume::calcBBHolder() {
     bbHolder.addPoint( minpt );
 }
 
+void CutterVolume::calcBBSegments(double bottom) {
+    const double lo[CUTTER_SEGMENTS] = { -bottom, flutelength, reachlength };
+    const double hi[CUTTER_SEGMENTS] = { flutelength, reachlength, length };
+    const double r[CUTTER_SEGMENTS]  = { radius, neckradius, shankradius };
+    for (int s=0;s<CUTTER_SEGMENTS;++s) {
+        bbSegment[s].clear();
+        bbSegment[s].addPoint( GLVertex(center.x + r[s] + TOLERANCE, center.y + r[s] + TOLERANCE, center.z + hi[s] + TOLERANCE) );
+        bbSegment[s].addPoint( GLVertex(center.x - r[s] - TOLERANCE, center.y - r[s] - TOLERANCE, center.z + lo[s] - TOLERANCE) );
+    }
+}
+
+void CutterVolume::setBBAngle(const GLVertex& a) {
+    bb.setAngle(a);
+    if (enableholder)
+        bbHolder.setAngle(a);
+    for (int s=0;s<CUTTER_SEGMENTS;++s)
+        bbSegment[s].setAngle(a);
+}
+
+// Within one segment (flute, neck, shank, holder) the distance of dist_cd() changes at most as much
+// as the position, so the ball is classified by comparing the distance at p with r. Where the ball
+// crosses into other segments, the distance may jump by the difference of the segment radii.
+CutterCull CutterVolume::cull(const GLVertex& p, double r, double& f, double& bound) const {
+    Cutting c = dist_cd(p);
+    f = c.f;
+    double top = axialHeight(p) + r;
+    const double boundary[3] = { flutelength, reachlength, length };
+    const double segmentradius[3] = { neckradius, shankradius, holderradius };
+    double rmin = radius, rmax = radius;
+    for (int n=0;n<3;++n) {
+        if (top > boundary[n]) {
+            rmin = std::min(rmin, segmentradius[n]);
+            rmax = std::max(rmax, segmentradius[n]);
+        }
+    }
+    bound = r + (rmax - rmin) + CALC_TOLERANCE;
+    if (f < -bound)
+        return CULL_OUTSIDE;
+    else if (f > bound && top <= flutelength) // only the flutes may cut without collision
+        return CULL_INSIDE;
+    else
+        return CULL_UNDECIDED;
+}
+
+void CutterVolume::distBounds(const GLVertex& minpt, const GLVertex& maxpt, double& lower, double& upper) const {
+    double f, bound;
+    cull( (minpt + maxpt) * 0.5, (maxpt - minpt).norm() * 0.5, f, bound );
+    lower = f - bound;
+    upper = f + bound;
+}
+
+double CutterVolume::axialHeight(const GLVertex& p) const {
+#ifdef MULTI_AXIS
+    GLVertex rotated_p = p;
+    rotated_p = rotated_p.rotateAC(rotation);
+    return rotated_p.z - center.z;
+#else
+    return p.z - center.z;
+#endif
+}
+
+void CutterVolume::dist_cd8(const Corners& p, unsigned int active, Cutting r[8]) const {
+    for (int n = 0; n < 8; ++n) {
+        if ( active & (1 << n) )
+            r[n] = dist_cd( GLVertex(p.x[n], p.y[n], p.z[n]) );
+    }
+}
+
 //************* CylCutterVolume **************/
 
 CylCutterVolume::CylCutterVolume() {
+    cuttertype = CYLINDER;
     radius = 0.0;
     length = 0.0;
 }
@@ -521,6 +806,7 @@ void CylCutterVolume::calcBB() {
     GLVertex minpt = GLVertex(center.x - maxradius - TOLERANCE, center.y - maxradius - TOLERANCE, center.z - TOLERANCE);
     bb.addPoint( maxpt );
     bb.addPoint( minpt );
+    calcBBSegments(0.0);
     if (enableholder)
         calcBBHolder();
 }
@@ -528,7 +814,7 @@ void CylCutterVolume::calcBB() {
 double CylCutterVolume::dist(const GLVertex& p) const {
 #ifdef MULTI_AXIS
 	GLVertex rotated_p = p;
-	rotated_p = rotated_p.rotateAC(angle.x, angle.z);
+	rotated_p = rotated_p.rotateAC(rotation);
 	GLVertex t = rotated_p - center;
 	double d = (rotated_p - GLVertex(center.x, center.y, rotated_p.z)).norm();
 #else
@@ -551,16 +837,22 @@ double CylCutterVolume::dist(const GLVertex& p) const {
 	}
 }
 
-Cutting CylCutterVolume::dist_cd(const GLVertex& p) {
+Cutting CylCutterVolume::dist_cd(const GLVertex& p) const {
 #ifdef MULTI_AXIS
     GLVertex rotated_p = p;
-    rotated_p = rotated_p.rotateAC(angle.x, angle.z);
-    GLVertex t = rotated_p - center;
-    double d = (rotated_p - GLVertex(center.x, center.y, rotated_p.z)).norm();
+    rotated_p = rotated_p.rotateAC(rotation);
+    return profile_cd( rotated_p - center );
 #else
-    GLVertex t = p - center;
-    double d = (p - GLVertex(center.x, center.y, p.z)).norm();
+    return profile_cd( p - center );
 #endif
+}
+
+void CylCutterVolume::dist_cd8(const Corners& p, unsigned int active, Cutting r[8]) const {
+    dist_cd8_kernel(p, active, r);
+}
+
+Cutting CylCutterVolume::profile_cd(const GLVertex& t) const {
+    double d = GLVertex(t.x, t.y, 0.0).norm();
     Cutting result = { t.z, NO_COLLISION };
     double rdiff = radius - d;
 
@@ -587,6 +879,7 @@ Cutting CylCutterVolume::dist_cd(const GLVertex& p) {
 //************* BallCutterVolume **************/
 
 BallCutterVolume::BallCutterVolume() {
+    cuttertype = BALL;
     radius = 0.0;
     length = 0.0;
 }
@@ -597,6 +890,7 @@ void BallCutterVolume::calcBB() {
     GLVertex minpt = GLVertex(center.x - maxradius - TOLERANCE, center.y - maxradius - TOLERANCE, center.z - radius - TOLERANCE);
     bb.addPoint( maxpt );
     bb.addPoint( minpt );
+    calcBBSegments(radius);
     if (enableholder)
         calcBBHolder();
 }
@@ -604,7 +898,7 @@ void BallCutterVolume::calcBB() {
 double BallCutterVolume::dist(const GLVertex& p) const {
 #ifdef MULTI_AXIS
     GLVertex rotated_p = p;
-    rotated_p = rotated_p.rotateAC(angle.x, angle.z);
+    rotated_p = rotated_p.rotateAC(rotation);
     GLVertex t = rotated_p - center;
 #else
     GLVertex t = p - center;
@@ -624,29 +918,28 @@ double BallCutterVolume::dist(const GLVertex& p) const {
 #endif
 }
 
-Cutting BallCutterVolume::dist_cd(const GLVertex& p) {
+Cutting BallCutterVolume::dist_cd(const GLVertex& p) const {
 #ifdef MULTI_AXIS
     GLVertex rotated_p = p;
-    rotated_p = rotated_p.rotateAC(angle.x, angle.z);
-    GLVertex t = rotated_p - center;
+    rotated_p = rotated_p.rotateAC(rotation);
+    return profile_cd( rotated_p - center );
 #else
-    GLVertex t = p - center;
+    return profile_cd( p - center );
 #endif
+}
+
+void BallCutterVolume::dist_cd8(const Corners& p, unsigned int active, Cutting r[8]) const {
+    dist_cd8_kernel(p, active, r);
+}
+
+Cutting BallCutterVolume::profile_cd(const GLVertex& t) const {
     Cutting result = { 0.0, NO_COLLISION };
 
     if (t.z < 0) {
-#ifdef MULTI_AXIS
-    	  result.f = radius - (rotated_p - GLVertex(center.x, center.y, center.z)).norm();
-#else
-    	  result.f = radius - (center - p).norm();
-#endif
+    	  result.f = radius - t.norm();
     	  return result;
     } else {
-#ifdef MULTI_AXIS
-  	  double d = (rotated_p - GLVertex(center.x, center.y, rotated_p.z)).norm();
-#else
-  	  double d = (p - GLVertex(center.x, center.y, p.z)).norm();
-#endif
+  	  double d = GLVertex(t.x, t.y, 0.0).norm();
   	  result.f = radius - d;
   	  result.collision |= ((t.z > flutelength) && ((result.f = neckradius  - d) > COLLISION_TOLERANCE))  ? NECK_COLLISION   : NO_COLLISION;
   	  result.collision |= ((t.z > reachlength) && ((result.f = shankradius - d) > COLLISION_TOLERANCE))  ? SHANK_COLLISION  : NO_COLLISION;
@@ -655,6 +948,254 @@ Cutting BallCutterVolume::dist_cd(const GLVertex& p) {
     }
 }
 
+//************* SweptCutterVolume **************/
+
+SweptCutterVolume::SweptCutterVolume() {
+    cutter = NULL;
+    arcangle = 0.0;
+    pathlength = 0.0;
+}
+
+void SweptCutterVolume::setMove(const GLVertex& start, const GLVertex& end) {
+    assert( cutter != NULL && cutter->cuttertype != NO_TOOL );
+    cutter->setCenter(start);
+    CutterVolume::operator=(*cutter); // dimensions, angle, center and bounding-boxes at the start
+    cutter->setCenter(end);
+    move = cutter->getCenter() - center;
+    arccenter = GLVertex(0.0, 0.0, 0.0);
+    arcangle = 0.0;
+    pathlength = move.norm();
+    bb.addPoint( cutter->bb.minpt );
+    bb.addPoint( cutter->bb.maxpt );
+    for (int s=0;s<CUTTER_SEGMENTS;++s) {
+        bbSegment[s].addPoint( cutter->bbSegment[s].minpt );
+        bbSegment[s].addPoint( cutter->bbSegment[s].maxpt );
+    }
+    if (enableholder) {
+        bbHolder.addPoint( cutter->bbHolder.minpt );
+        bbHolder.addPoint( cutter->bbHolder.maxpt );
+    }
+}
+
+void SweptCutterVolume::setArc(const GLVertex& start, const GLVertex& end, const GLVertex& arc_center, double sweep) {
+    assert( cutter != NULL && cutter->cuttertype != NO_TOOL );
+    cutter->setCenter(start);
+    CutterVolume::operator=(*cutter);
+    cutter->setCenter(end);
+    move = cutter->getCenter() - center;
+    arccenter = GLVertex(arc_center.x - center.x, arc_center.y - center.y, 0.0);
+    arcangle = sweep;
+    double r = arccenter.norm();
+    pathlength = sqrt( (r * sweep) * (r * sweep) + move.z * move.z );
+    bb.addPoint( cutter->bb.minpt );
+    bb.addPoint( cutter->bb.maxpt );
+    for (int s=0;s<CUTTER_SEGMENTS;++s) {
+        bbSegment[s].addPoint( cutter->bbSegment[s].minpt );
+        bbSegment[s].addPoint( cutter->bbSegment[s].maxpt );
+    }
+    if (enableholder) {
+        bbHolder.addPoint( cutter->bbHolder.minpt );
+        bbHolder.addPoint( cutter->bbHolder.maxpt );
+    }
+    std::vector<GLVertex> extremes;
+    getArcExtremes(extremes);
+    for (unsigned int k=0;k<extremes.size();++k) {
+        GLVertex d = extremes[k] - cutter->getCenter();
+        bb.addPoint( cutter->bb.minpt + d );
+        bb.addPoint( cutter->bb.maxpt + d );
+        for (int s=0;s<CUTTER_SEGMENTS;++s) {
+            bbSegment[s].addPoint( cutter->bbSegment[s].minpt + d );
+            bbSegment[s].addPoint( cutter->bbSegment[s].maxpt + d );
+        }
+        if (enableholder) {
+            bbHolder.addPoint( cutter->bbHolder.minpt + d );
+            bbHolder.addPoint( cutter->bbHolder.maxpt + d );
+        }
+    }
+}
+
+// the arc reaches furthest out where it crosses the x- and y-directions from its center
+void SweptCutterVolume::getArcExtremes(std::vector<GLVertex>& p) const {
+    p.clear();
+    if (arcangle == 0.0)
+        return;
+    double start_angle = atan2(-arccenter.y, -arccenter.x);
+    for (int k=-8;k<=8;++k) {
+        double s = (k * 0.5 * PI - start_angle) / arcangle;
+        if (s > 0.0 && s < 1.0)
+            p.push_back( center + offset(s) );
+    }
+}
+
+GLVertex SweptCutterVolume::offset(double s) const {
+    if (arcangle == 0.0)
+        return move * s;
+    double c = cos(s * arcangle), sn = sin(s * arcangle);
+    // rotate the vector from the arc center to the start by s*arcangle
+    return GLVertex( arccenter.x - arccenter.x * c + arccenter.y * sn,
+                     arccenter.y - arccenter.x * sn - arccenter.y * c, move.z * s );
+}
+
+double SweptCutterVolume::axialHeight(const GLVertex& p) const {
+    return CutterVolume::axialHeight(p) - std::min(0.0, (double)move.z); // above the lowest center of the move
+}
+
+double SweptCutterVolume::fluteDist(const GLVertex& t) const {
+    double d = GLVertex(t.x, t.y, 0.0).norm();
+    if (cuttertype == BALL)
+        return radius - ( (t.z < 0.0) ? t.norm() : d );
+    if (t.z >= 0.0)
+        return std::min(radius - d, (double)t.z);
+    else if (d < radius)
+        return t.z;
+    else
+        return -sqrt( (d - radius) * (d - radius) + t.z * t.z );
+}
+
+double SweptCutterVolume::closestParameter(const GLVertex& t, double slo, double shi) const {
+    if (arcangle == 0.0) {
+        double h2 = move.x * move.x + move.y * move.y;
+        double s = (h2 > 0.0) ? (t.x * move.x + t.y * move.y) / h2 : 0.0;
+        return std::max(slo, std::min(shi, s));
+    }
+    // the axis passes closest to p where the arc crosses the direction of p from the arc center
+    GLVertex q = t - arccenter;
+    if (q.x * q.x + q.y * q.y < CALC_TOLERANCE * CALC_TOLERANCE)
+        return slo;
+    double phi = atan2(q.y, q.x);
+    double start_angle = atan2(-arccenter.y, -arccenter.x);
+    double ulo = start_angle + std::min(slo * arcangle, shi * arcangle);
+    double uhi = start_angle + std::max(slo * arcangle, shi * arcangle);
+    double u = phi + 2.0 * PI * ceil( (ulo - phi) / (2.0 * PI) );
+    if (u > uhi) // not crossed, take the end of the range closer in angle
+        u = ( cos(ulo - phi) > cos(uhi - phi) ) ? ulo : uhi;
+    return std::max(slo, std::min(shi, (u - start_angle) / arcangle));
+}
+
+// fluteDist() is concave along a straight move, so its maximum within [slo,shi] is the
+// unconstrained maximum clamped to the range.
+double SweptCutterVolume::fluteParameter(const GLVertex& t, double slo, double shi) const {
+    if (arcangle != 0.0) {
+        if (fabs(move.z) < CALC_TOLERANCE) // planar arc: p lies at the same height, the flutes reach furthest closest to p
+            return closestParameter(t, slo, shi);
+        // helix: sample every PI/16 of turn and refine each local maximum by golden-section search.
+        // There is about one local maximum per turn.
+        const double step = PI / 16.0;
+        int n = std::max(1, (int)ceil( fabs(arcangle) * (shi - slo) / step ));
+        double ds = (shi - slo) / n;
+        std::vector<double> f(n + 1);
+        for (int i=0;i<=n;++i)
+            f[i] = fluteDist( t - offset(slo + i * ds) );
+        double best = -std::numeric_limits<double>::max(), s = slo;
+        for (int i=0;i<=n;++i) {
+            if ( (i > 0 && f[i-1] > f[i]) || (i < n && f[i+1] > f[i]) )
+                continue;
+            double si = searchFlute(t, std::max(slo, slo + (i-1) * ds), std::min(shi, slo + (i+1) * ds));
+            double fi = fluteDist( t - offset(si) );
+            if (fi > best) {
+                best = fi;
+                s = si;
+            }
+        }
+        return s;
+    }
+    double h2 = move.x * move.x + move.y * move.y;
+    if (cuttertype == BALL) {
+        // closest point to t on the capsule axis {s*move + z*(0,0,1) : 0<=s<=1, z>=0}
+        double best = std::numeric_limits<double>::max(), s = 0.0;
+        double m2 = h2 + move.z * move.z;
+        double candidate[4] = { 0.0, 1.0, (m2 > 0.0) ? t.dot(move) / m2 : 0.0, (h2 > 0.0) ? (t.x * move.x + t.y * move.y) / h2 : 0.0 };
+        for (int n=0;n<4;++n) {
+            double c = std::max(0.0, std::min(1.0, candidate[n]));
+            GLVertex q = t - move * c;
+            double z = (n == 2) ? 0.0 : std::max(0.0, (double)q.z); // candidate 2 lies on the bottom edge z=0
+            double d2 = q.x * q.x + q.y * q.y + (q.z - z) * (q.z - z);
+            if (d2 < best) {
+                best = d2;
+                s = c;
+            }
+        }
+        return std::max(slo, std::min(shi, s));
+    }
+    if (cuttertype != CYLINDER)
+        return slo;
+    if (h2 < CALC_TOLERANCE * CALC_TOLERANCE) // vertical move: the flutes reach furthest where p lies highest
+        return (move.z > 0.0) ? slo : shi;
+    if (fabs(move.z) < CALC_TOLERANCE) // horizontal move: closest approach of the axis
+        return closestParameter(t, slo, shi);
+    return searchFlute(t, slo, shi); // ramp
+}
+
+double SweptCutterVolume::searchFlute(const GLVertex& t, double a, double b) const {
+    const double g = 0.5 * (sqrt(5.0) - 1.0);
+    double s1 = b - g * (b - a), s2 = a + g * (b - a);
+    double f1 = fluteDist(t - offset(s1)), f2 = fluteDist(t - offset(s2));
+    while ((b - a) * pathlength > TOLERANCE * 0.1) {
+        if (f1 < f2) {
+            a = s1; s1 = s2; f1 = f2;
+            s2 = a + g * (b - a);
+            f2 = fluteDist(t - offset(s2));
+        } else {
+            b = s2; s2 = s1; f2 = f1;
+            s1 = b - g * (b - a);
+            f1 = fluteDist(t - offset(s1));
+        }
+    }
+    return 0.5 * (a + b);
+}
+
+// range of s in [0,1] where p lies zlo < z <= zhi above the cutter center at offset(s).
+// Ends within the move are pulled in by 0.01*TOLERANCE in height, well above the float
+// resolution of the vertices, so that the cutter evaluated there lies within the segment.
+static bool sweepRange(double tz, double dz, double zlo, double zhi, double& slo, double& shi) {
+    slo = 0.0;
+    shi = 1.0;
+    if (fabs(dz) < CALC_TOLERANCE) // p stays at the same height
+        return (tz > zlo && tz <= zhi);
+    double s1 = (tz - zlo) / dz;
+    double s2 = (tz - zhi) / dz;
+    slo = std::max(0.0, std::min(s1, s2));
+    shi = std::min(1.0, std::max(s1, s2));
+    if (slo > shi)
+        return false;
+    double margin = 0.01 * TOLERANCE / fabs(dz);
+    double lo = (slo > 0.0) ? slo + margin : slo;
+    double hi = (shi < 1.0) ? shi - margin : shi;
+    if (lo <= hi) {
+        slo = lo;
+        shi = hi;
+    } else { // p passes the segment only briefly, take the middle
+        slo = shi = 0.5 * (slo + shi);
+    }
+    return true;
+}
+
+// the largest distance along the move is found per segment of the cutter: the flutes at
+// fluteParameter(), the cylindrical neck, shank and holder at closestParameter().
+// The height of p above the cutter center changes linearly along the move, also on a helix.
+Cutting SweptCutterVolume::dist_cd(const GLVertex& p) const {
+#ifdef MULTI_AXIS
+    GLVertex rotated_p = p;
+    rotated_p = rotated_p.rotateAC(rotation);
+    GLVertex t = rotated_p - center;
+#else
+    GLVertex t = p - center;
+#endif
+    const double boundary[5] = { -std::numeric_limits<double>::max(), flutelength, reachlength, length, std::numeric_limits<double>::max() };
+    Cutting result = { -std::numeric_limits<double>::max(), NO_COLLISION };
+    for (int n=0;n<4;++n) {
+        double slo, shi;
+        if (!sweepRange(t.z, move.z, boundary[n], boundary[n+1], slo, shi))
+            continue;
+        double s = (n == 0) ? fluteParameter(t, slo, shi) : closestParameter(t, slo, shi);
+        Cutting c = cutter->profile_cd( t - offset(s) );
+        if (c.f > result.f)
+            result.f = c.f;
+        result.collision |= c.collision;
+    }
+    return result;
+}
+
 //************* BullCutterVolume **************/
 // TOROID 
 
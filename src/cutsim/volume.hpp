@@ -27,12 +27,25 @@
 
 #include "bbox.hpp"
 #include "facet.hpp"
+#include "facet_tree.hpp"
+#include "sdf_grid.hpp"
 #include "glvertex.hpp"
 #include "gldata.hpp"
 #include "stl.hpp"
 
 namespace cutsim {
 
+/// the eight corner points of an octree node, stored coordinate by coordinate
+/// for the kernels which evaluate a Volume at all corners at once
+struct Corners {
+    /// x-coordinates
+    GLfloat x[8];
+    /// y-coordinates
+    GLfloat y[8];
+    /// z-coordinates
+    GLfloat z[8];
+};
+
 /// base-class for defining implicit volumes from which to build octrees
 /// an implicit volume is defined as a function dist(Point p)
 /// which returns a positive value inside the volume and a negative value outside.
@@ -64,6 +77,13 @@ class Volume {
         /// Points p inside the volume should return positive values.
         /// Points p outside the volume should return negative values.
         virtual double dist(const GLVertex& p) const = 0;
+        /// signed distance at the eight corners p, into d.
+        /// The default calls dist() for each corner, volumes on the inner loop override it with a Float8 kernel.
+        virtual void dist8(const Corners& p, double d[8]) const;
+        /// bounds of dist() over the axis-aligned box [minpt, maxpt], into lower and upper.
+        /// The default takes dist() for a distance, which changes by at most the distance
+        /// moved, and bounds it around the center of the box.
+        virtual void distBounds(const GLVertex& minpt, const GLVertex& maxpt, double& lower, double& upper) const;
 
         /// bounding-box. This holds the maximum(minimum) points along the X,Y, and Z-coordinates
         /// of the volume (i.e. the volume where dist(p) returns negative values)
@@ -104,6 +124,9 @@ class SphereVolume: public Volume {
         /// update the Bbox
         void calcBB();
         double dist(const GLVertex& p) const;
+        void dist8(const Corners& p, double d[8]) const;
+        /// exact, from the nearest and the farthest point of the box
+        void distBounds(const GLVertex& minpt, const GLVertex& maxpt, double& lower, double& upper) const;
         
         /// center Point of sphere
         GLVertex center;
@@ -132,6 +155,8 @@ class RectVolume : public Volume {
         /// update the bounding-box
         void calcBB();
         double dist(const GLVertex& p) const;
+        /// from the distance of the box center to the box of this volume
+        void distBounds(const GLVertex& minpt, const GLVertex& maxpt, double& lower, double& upper) const;
 };
 
 /// box-volume2
@@ -175,14 +200,19 @@ class RectVolume2 : public Volume {
         /// set the rotation center of box
         void setRotationCenter(GLVertex c) {
             rotationCenter = c;
+            calcRotation();
         }
         /// set the angle of box
         void setAngle(GLVertex a) {
             angle = a;
+            calcRotation();
         }
         /// update the bounding-box
         void calcBB();
         double dist(const GLVertex& p) const;
+        void dist8(const Corners& p, double d[8]) const;
+        /// from the distance of the box center to the box of this volume
+        void distBounds(const GLVertex& minpt, const GLVertex& maxpt, double& lower, double& upper) const;
 
     private:
         /// one corner of the left bottom of box
@@ -199,6 +229,12 @@ class RectVolume2 : public Volume {
         GLVertex rotationCenter;
         /// box angle
         GLVertex angle;
+        /// rotation matrix of angle
+        GLfloat rotation[3][3];
+        /// translation after the rotation, for rotating about rotationCenter
+        GLVertex shift;
+        /// update rotation and shift from angle and rotationCenter
+        void calcRotation();
 };
 
 /// cylinder volume
@@ -225,14 +261,18 @@ class CylinderVolume: public Volume {
         /// set the rotation center of clynder
         void setRotationCenter(GLVertex c) {
             rotationCenter = c;
+            calcRotation();
         }
         /// set the angle of cylinder
         void setAngle(GLVertex a) {
             angle = a;
+            calcRotation();
         }
         /// update the bounding-box of cylinder
         void calcBB();
         double dist(const GLVertex& p) const;
+        void dist8(const Corners& p, double d[8]) const;
+        void distBounds(const GLVertex& minpt, const GLVertex& maxpt, double& lower, double& upper) const;
 
     private:
         /// cylinder radius
@@ -245,6 +285,12 @@ class CylinderVolume: public Volume {
         GLVertex rotationCenter;
         /// cylinder angle
         GLVertex angle;
+        /// rotation matrix of angle
+        GLfloat rotation[3][3];
+        /// translation after the rotation, for rotating about rotationCenter
+        GLVertex shift;
+        /// update rotation and shift from angle and rotationCenter
+        void calcRotation();
 };
 
 /// STL volume
@@ -252,11 +298,7 @@ class StlVolume: public Stl, public Volume {
 
     public:
         StlVolume();
-        virtual ~StlVolume() {
-        	V21.resize(0); invV21dotV21.resize(0);
-        	V32.resize(0); invV32dotV32.resize(0);
-        	V13.resize(0); invV13dotV13.resize(0);
-        }
+        virtual ~StlVolume() {}
 
         /// set the center of STL
         void setCenter(GLVertex v) {
@@ -273,22 +315,28 @@ class StlVolume: public Stl, public Volume {
         /// update the bounding-box of STL
         void calcBB();
         double dist(const GLVertex& p) const;
+        /// around the distance at the box center, from the sampled grid where dist() uses it
+        void distBounds(const GLVertex& minpt, const GLVertex& maxpt, double& lower, double& upper) const;
 
-        int readStlFile(QString file) {  int retval = Stl::readStlFile(file); calcBB(); return retval; }
+        int readStlFile(QString file) {
+            fileName = file.toStdString();
+            int retval = Stl::readStlFile(file);
+            calcBB();
+            return retval;
+        }
+        /// sample dist() on a grid of spacing step through anchor, in a band of STL_SDF_BAND steps
+        /// around the surface. The grid is read from the file next to the STL file if it was sampled
+        /// for the same STL, step and placement, else it is sampled and written there.
+        /// Returns true if the grid was read from the file.
+        bool useSdfGrid(const GLVertex& anchor, double step);
 
     private:
-        // V21[i] = facets[i]->v2 - facets[i]->v1
-        std::vector<GLVertex> V21;
-        // 1/<V21[i], V21[i]>
-        std::vector<double> invV21dotV21;
-        // V32[i] = facets[i]->v3 - facets[i]->v2
-        std::vector<GLVertex> V32;
-        // 1/<V32[i], V32[i]>
-        std::vector<double> invV32dotV32;
-        // V13[i] = facets[i]->v1 - facets[i]->v3
-        std::vector<GLVertex> V13;
-        // 1/<V13[i], V13[i]>
-        std::vector<double> invV13dotV13;
+        /// the facets, for the nearest-facet search of dist()
+        FacetTree tree;
+        /// sampled distance near the surface, used by dist() where valid
+        SdfGrid grid;
+        /// the STL file read by readStlFile()
+        std::string fileName;
         /// STL center
         GLVertex center;
         /// center of rotation
@@ -297,6 +345,44 @@ class StlVolume: public Stl, public Volume {
         GLVertex angle;
 };
 
+/// boolean operation of a CsgVolume term
+typedef enum {
+       CSG_SUM					= 0,
+       CSG_DIFF					= 1,
+       CSG_INTERSECT			= 2,
+} CsgOperation;
+
+/// composite of Volumes combined in turn by sum, diff or intersect, starting from an empty volume.
+/// Octree::apply() builds the stock from it in one traversal, with the same surface as one
+/// Octree::sum(), diff() or intersect() per term. The CsgVolume owns and deletes its terms.
+class CsgVolume: public Volume {
+    public:
+        CsgVolume() : empty(true) {}
+        virtual ~CsgVolume();
+        /// combine vol with the terms added so far by op. Its bounding-box must be up to date.
+        void add(CsgOperation op, Volume* vol);
+        /// number of terms
+        unsigned int size() const { return terms.size(); }
+        /// the operation of term i
+        CsgOperation operation(unsigned int i) const { return terms[i].op; }
+        /// the Volume of term i
+        const Volume* volume(unsigned int i) const { return terms[i].vol; }
+        /// the terms folded over p. Very negative if nothing is summed.
+        double dist(const GLVertex& p) const;
+        /// the bounds of the terms folded as dist() folds their distances
+        void distBounds(const GLVertex& minpt, const GLVertex& maxpt, double& lower, double& upper) const;
+
+    private:
+        /// a Volume and its operation
+        struct Term {
+            CsgOperation op;
+            Volume* vol;
+        };
+        /// the terms in the order they are applied
+        std::vector<Term> terms;
+        /// true while the composite is empty, before the first sum and after an empty intersection
+        bool empty;
+};
 
 typedef enum {
        NO_TOOL				= 0,
@@ -317,6 +403,21 @@ typedef struct cutting {
 	int		collision;
 } Cutting;
 
+/// the segments of a cutter along its axis, below the holder. Only the flutes cut without collision.
+typedef enum {
+		FLUTE_SEGMENT		= 0,
+		NECK_SEGMENT		= 1,
+		SHANK_SEGMENT		= 2,
+		CUTTER_SEGMENTS		= 3,
+} CutterSegment;
+
+/// classification of a ball against a cutter
+typedef enum {
+		CULL_UNDECIDED		= 0,	// the cutter surface may pass through the ball
+		CULL_INSIDE			= 1,	// the ball lies inside the flutes
+		CULL_OUTSIDE		= 2,	// the ball lies outside the cutter
+} CutterCull;
+
 /// cylindrical cutter volume
 
 class CutterVolume: public Volume {
@@ -343,6 +444,8 @@ class CutterVolume: public Volume {
         GLVertex center;
         /// cutter angle
         GLVertex angle;
+        /// rotation matrix of angle, from the machine frame into the frame of the cutter
+        GLfloat rotation[3][3];
 
         /// Holder variables
         bool enableholder;
@@ -371,6 +474,16 @@ class CutterVolume: public Volume {
         Bbox bbHolder;
         /// update the Bbox
         void calcBBHolder();
+        /// boxes of the flutes, the neck and the shank in the frame of the cutter, whose union is bb
+        Bbox bbSegment[CUTTER_SEGMENTS];
+        /// true if segment s has a length. The box of a segment without length is not used.
+        bool hasSegment(int s) const {
+            return (s == FLUTE_SEGMENT) || (s == NECK_SEGMENT && reachlength > flutelength) || (s == SHANK_SEGMENT && length > reachlength);
+        }
+        /// update bbSegment, for flutes which reach down to bottom below the center
+        void calcBBSegments(double bottom);
+        /// turn bb, bbHolder and bbSegment by the angle a
+        void setBBAngle(const GLVertex& a);
 
         virtual void setRadius(double r) {}
         virtual void setAngle(GLVertex a) {}
@@ -378,8 +491,20 @@ class CutterVolume: public Volume {
         virtual void setTool(CutterVolume* cutter) {}
         virtual GLVertex getCenter() { return GLVertex(0.0, 0.0, 0.0); }
         virtual GLVertex getAngle() { return GLVertex(0.0, 0.0, 0.0); }
-        virtual	Cutting dist_cd(const GLVertex& p) { Cutting r = { 0.0, NO_COLLISION }; return r; }
+        virtual	Cutting dist_cd(const GLVertex& p) const { Cutting r = { 0.0, NO_COLLISION }; return r; }
+        /// dist_cd() at the corners p whose bit is set in active, into r.
+        /// The default calls dist_cd() for each of them, a kernel may evaluate all eight corners.
+        virtual void dist_cd8(const Corners& p, unsigned int active, Cutting r[8]) const;
+        /// distance and collision at the offset t from the cutter center, in the coordinate frame of the cutter
+        virtual Cutting profile_cd(const GLVertex& t) const { Cutting r = { 0.0, NO_COLLISION }; return r; }
+        /// height of p above the cutter center along the cutter axis
+        virtual double axialHeight(const GLVertex& p) const;
         double dist(const GLVertex& p) const { return 0.0; }
+        /// classify the ball of radius r around p from the distance f at p.
+        /// The distance anywhere in the ball lies within f-bound and f+bound.
+        CutterCull cull(const GLVertex& p, double r, double& f, double& bound) const;
+        /// the bounds of cull() over the ball around the box
+        void distBounds(const GLVertex& minpt, const GLVertex& maxpt, double& lower, double& upper) const;
 };
 
 /// cylindrical cutter volume
@@ -410,29 +535,30 @@ class CylCutterVolume: public CutterVolume {
         /// set the angle of Cylindrical Cutter
         void setAngle(GLVertex a) {
             angle = a;
-            bb.angle = a;
-            if (enableholder)
-            	bbHolder.angle = a;
+            GLVertex::rotationAC(a.x, a.z, rotation);
+            setBBAngle(a);
          }
         /// set the flute length of Cylindrical Cutter
         void setFluteLength(double fl) {
         	flutelength = fl;
+        	calcBB();
         }
         /// set the neck radius of Cylindrical Cutter
         void setNeckRadius(double nr) {
             neckradius = nr;
+            calcBB();
         }
         /// set the reach length of Cylindrical Cutter
         void setReachLength(double rl) {
         	reachlength = rl;
+        	calcBB();
         }
         /// set the shank radius of Cylindrical Cutter
         void setShankRadius(double sr) {
             shankradius = sr;
-            if (shankradius > radius) {
+            if (shankradius > radius)
             	maxradius = sr;
-            	calcBB();
-            }
+            calcBB();
         }
         /// get the centerpoint of Cylindrical Cutter
         GLVertex getCenter() { return center; }
@@ -441,7 +567,11 @@ class CylCutterVolume: public CutterVolume {
         /// update the Bbox
         void calcBB();
         double dist(const GLVertex& p) const;
-        Cutting dist_cd(const GLVertex& p);
+        Cutting dist_cd(const GLVertex& p) const;
+        void dist_cd8(const Corners& p, unsigned int active, Cutting r[8]) const;
+        /// the Float8 kernel of dist_cd8(), defined inline in cutter_kernel.hpp
+        inline void dist_cd8_kernel(const Corners& p, unsigned int active, Cutting r[8]) const;
+        Cutting profile_cd(const GLVertex& t) const;
 };
 
 /// ball-nose cutter volume
@@ -473,29 +603,30 @@ class BallCutterVolume: public CutterVolume {
         /// set the angle of Ball Cutter
         void setAngle(GLVertex a) {
             angle = a;
-            bb.angle = a;
-            if (enableholder)
-            	bbHolder.angle = a;
+            GLVertex::rotationAC(a.x, a.z, rotation);
+            setBBAngle(a);
         }
         /// set the flute length of Ball Cutter
         void setFluteLength(double fl) {
         	   flutelength = fl - radius;
+        	   calcBB();
         }
         /// set the neck radius of Ball Cutter
         void setNeckRadius(double nr) {
             neckradius = nr;
+            calcBB();
         }
         /// set the reach length of Ball Cutter
         void setReachLength(double rl) {
         	reachlength = rl - radius;
+        	calcBB();
         }
         /// set the shank radius of Ball Cutter
         void setShankRadius(double sr) {
             shankradius = sr;
-            if (shankradius > radius) {
+            if (shankradius > radius)
             	maxradius = sr;
-            	calcBB();
-            }
+            calcBB();
         }
         /// get the centerpoint of Ball Cutter
         GLVertex getCenter() { return center; }
@@ -504,7 +635,65 @@ class BallCutterVolume: public CutterVolume {
         /// update bounding box
         void calcBB();
         double dist(const GLVertex& p) const;
-        Cutting dist_cd(const GLVertex& p);
+        Cutting dist_cd(const GLVertex& p) const;
+        void dist_cd8(const Corners& p, unsigned int active, Cutting r[8]) const;
+        /// the Float8 kernel of dist_cd8(), defined inline in cutter_kernel.hpp
+        inline void dist_cd8_kernel(const Corners& p, unsigned int active, Cutting r[8]) const;
+        Cutting profile_cd(const GLVertex& t) const;
+};
+
+/// volume swept by a cutter which moves along a straight line or a helical arc about the
+/// cutter axis, without changing its angle. The distance at p is the largest distance of the
+/// cutter anywhere along the move, so one diff removes what diffing the cutter at every
+/// point of the move would remove.
+/// On a straight move the flutes of a ball cutter sweep a capsule and those of a cylindrical
+/// cutter an extruded disk, on a planar arc both sweep a torus segment; all continued upwards.
+/// Neck, shank and holder are evaluated where they pass closest to p.
+class SweptCutterVolume: public CutterVolume {
+
+    public:
+        SweptCutterVolume();
+        /// sweep the given cutter
+        void setTool(CutterVolume* c) { cutter = c; }
+        /// move the cutter from position start to end, at its current angle. The cutter is left at end.
+        void setMove(const GLVertex& start, const GLVertex& end);
+        /// move the cutter from position start to end on a helical arc about the axis through arc_center,
+        /// turning by sweep radians (counterclockwise positive). The cutter is left at end.
+        void setArc(const GLVertex& start, const GLVertex& end, const GLVertex& arc_center, double sweep);
+        /// get the centerpoint of the cutter at the end of the move
+        GLVertex getCenter() { return center + offset(1.0); }
+        /// get the angle of the cutter
+        GLVertex getAngle()  { return angle; }
+        /// the length of the path of the cutter center
+        double getPathLength() const { return pathlength; }
+        /// the centerpoints of the cutter between the start and the end of an arc where it reaches furthest in x or y
+        void getArcExtremes(std::vector<GLVertex>& p) const;
+        Cutting dist_cd(const GLVertex& p) const;
+        /// the distance of dist_cd(), used by diff() above max_depth
+        double dist(const GLVertex& p) const { return dist_cd(p).f; }
+        double axialHeight(const GLVertex& p) const;
+
+    protected:
+        /// the offset of the cutter center at position s in [0,1] along the move from the start
+        GLVertex offset(double s) const;
+        /// distance of the flutes, continued upwards, at offset t from the cutter center
+        double fluteDist(const GLVertex& t) const;
+        /// the position in [slo,shi] along the move where the flutes reach furthest into p
+        double fluteParameter(const GLVertex& t, double slo, double shi) const;
+        /// the position in [slo,shi] along the move where the cutter axis passes closest to p
+        double closestParameter(const GLVertex& t, double slo, double shi) const;
+        /// golden-section search for the maximum of fluteDist() within [a,b]
+        double searchFlute(const GLVertex& t, double a, double b) const;
+        /// the swept cutter
+        CutterVolume* cutter;
+        /// the move of the cutter center, from the start to the end
+        GLVertex move;
+        /// the arc center, relative to the cutter center at the start. Horizontal.
+        GLVertex arccenter;
+        /// the angle turned by an arc, zero for a straight move
+        double arcangle;
+        /// the length of the path of the cutter center
+        double pathlength;
 };
 
 /// bull-nose cutter volume
@@ -69,6 +69,8 @@ class canonLine {
 #ifdef MULTI_AXIS
     virtual Point angle(double t) { assert(0); return Point(); }
 #endif
+    /// for an arc in the XY-plane, return its center and the angle it turns (counterclockwise positive)
+    virtual bool arcXY(Point& center, double& sweep) { return false; }
     // produce a canonLine based on string l, and previous machineStatus s
     static canonLine* canonLineFactory (std::string l, machineStatus s);
     
@@ -94,6 +94,23 @@ class GPlayer : public QObject {
             		plunge = (diff_z > TOLERANCE) ? POSITIVE_PLUNGE : (diff_z < -TOLERANCE) ? NEGATIVE_PLUNGE : NO_PLUNGE;
             		motionStatus |= plunge;
             	}
+#ifdef SWEPT_MOVE
+            	if ( sweepable(cl) ) {
+            		// signal the whole move at once
+            		Point start = cl->point(0.0);
+            		Point end = cl->point(move_length);
+            		Point center;
+            		double sweep = 0.0; // straight move
+            		cl->arcXY(center, sweep);
+#ifdef MULTI_AXIS
+            		Point angle = cl->angle(0.0);
+            		emit signalToolMove( start.x, start.y, start.z, end.x, end.y, end.z, center.x, center.y, sweep, angle.x, angle.y, angle.z, current_line, motionStatus, feed_rate );
+#else
+            		emit signalToolMove( start.x, start.y, start.z, end.x, end.y, end.z, center.x, center.y, sweep, current_line, motionStatus, feed_rate );
+#endif
+            		move_done = true;
+            	} else {
+#endif
                 // FIXME: handle first and last moves differently?
             	Point pos = cl->point( (double)(m) * interval_size );
 #ifdef MULTI_AXIS
@@ -107,6 +124,9 @@ class GPlayer : public QObject {
                 emit signalToolPosition( pos.x, pos.y, pos.z, current_line, motionStatus, feed_rate);
 #endif
                 m++; // advance along the move
+#ifdef SWEPT_MOVE
+            	}
+#endif
             } else {
                 // not motion, check for toolchange
                 if ( current_tool != cl->getStatus()->getTool() ) {
@@ -162,6 +182,13 @@ class GPlayer : public QObject {
     	void signalToolPosition( double x, double y, double z, double a, double b, double c, int line, int mstatus, double feedrate ); // 5-axis for now..
 #else
         void signalToolPosition( double x, double y, double z, int line, int mstatus, double feedrate ); // 3-axis.
+#endif
+        /// signal a move of the tool from x0,y0,z0 to x1,y1,z1 at once.
+        /// An arc in the XY-plane turns by sweep radians about cx,cy, a straight move has sweep zero.
+#ifdef MULTI_AXIS
+        void signalToolMove( double x0, double y0, double z0, double x1, double y1, double z1, double cx, double cy, double sweep, double a, double b, double c, int line, int mstatus, double feedrate );
+#else
+        void signalToolMove( double x0, double y0, double z0, double x1, double y1, double z1, double cx, double cy, double sweep, int line, int mstatus, double feedrate );
 #endif
         /// signal a tool change to new tool \param t
         void signalToolChange( int t );
@@ -171,6 +198,18 @@ class GPlayer : public QObject {
         void debugMessage(QString s);
 
     protected:
+        /// true if the cutter moves along a straight line or an arc in the XY-plane without changing its angle in canonLine cl
+        bool sweepable(canonLine* cl) {
+            Point center;
+            double sweep;
+            if ( !(cl->getMotionType() & (STRAIGHT_FEED | TRAVERSE)) && !cl->arcXY(center, sweep) )
+                return false;
+#ifdef MULTI_AXIS
+            return ( cl->angle(0.0).Distance( cl->angle(move_length) ) < CALC_TOLERANCE );
+#else
+            return true;
+#endif
+        }
         /// flag for first move of g-code
         bool first;
         /// index of current tool
@@ -216,6 +216,14 @@ Point helicalMotion::point(double s) {
     return Point( p[0], p[1], p[2] );
 }
 
+bool helicalMotion::arcXY(Point& center, double& sweep) {
+    if ( status.getPlane() != CANON_PLANE_XY )
+        return false;
+    center = Point( cx, cy, o[Z] ); // as in point()
+    sweep = dtheta;
+    return true;
+}
+
 // rotate by cos/sin. from emc2 gcodemodule.cc
 void helicalMotion::rotate(double &x, double &y, double c, double s) {
     double tx = x * c - y * s;
@@ -54,6 +54,8 @@ class helicalMotion: protected canonMotion {
 #endif
     /// return the length of this helix move
     double length();     
+    /// return the center and the turned angle of an arc in the XY-plane
+    bool arcXY(Point& center, double& sweep);
 
   private:    
     void rotate(double &x, double &y, double c, double s);